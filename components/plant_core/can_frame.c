@@ -0,0 +1,227 @@
+#include "can_frame.h"
+#include <stddef.h>
+#include <string.h>
+
+const uint32_t can_node_ids[CAN_NODE_COUNT] = CAN_NODE_IDS;
+static const uint8_t can_node_protocols[CAN_NODE_COUNT] = CAN_NODE_PROTOCOLS;
+
+enum {
+    FRAME_SINGLE = 0x0,
+    FRAME_FIRST = 0x1,
+    FRAME_CONSECUTIVE = 0x2,
+};
+
+typedef struct {
+    uint8_t wire_size; //bytes on the bus
+    bool is_signed;
+    uint8_t field_size; //bytes in SensorData
+    uint16_t offset; //into SensorData
+} CanField;
+
+static const CanField v2_fields[8] = { //index = CAN_FIELD_* bit
+    { 2, true, sizeof(int16_t), offsetof(SensorData, temperature_raw) },
+    { 2, false, sizeof(uint16_t), offsetof(SensorData, light_level) },
+    { 1, false, sizeof(uint16_t), offsetof(SensorData, humidity) },
+    { 2, false, sizeof(uint16_t), offsetof(SensorData, moisture) },
+    { 2, false, sizeof(uint16_t), offsetof(SensorData, ec) },
+    { 2, false, sizeof(uint16_t), offsetof(SensorData, ph_centi) },
+    { 2, false, sizeof(uint16_t), offsetof(SensorData, co2) },
+    { 4, false, sizeof(uint32_t), offsetof(SensorData, node_time_ms) },
+};
+
+int can_node_slot(uint32_t can_id) {
+    for (int i = 0; i < (int)CAN_NODE_COUNT; i++) { //at most 16 entries, a linear scan is cheapest
+        if (can_node_ids[i] == can_id) return i;
+    }
+    return -1;
+}
+
+void can_decoder_init(CanDecoder *dec) {
+    memset(dec, 0, sizeof(*dec));
+    memcpy(dec->protocol, can_node_protocols, sizeof(dec->protocol));
+}
+
+static bool decode_v1(uint8_t dlc, const uint8_t *data, SensorData *out) {
+    if (dlc < 8) return false;
+
+    int16_t raw_temp = (data[0] << 8) | data[1];
+    out->temperature_raw = raw_temp;
+    out->light_level = (data[2] << 8) | data[3];
+    out->humidity = (data[4] << 8) | data[5];
+    out->moisture = (data[6] << 8) | data[7];
+    out->fields = CAN_FIELDS_V1;
+    out->known = CAN_FIELDS_V1;
+    out->seq = 0;
+    return true;
+}
+
+static bool decode_v2_payload(const uint8_t *payload, size_t len, SensorData *out) {
+    if (len < 1) return false;
+    uint8_t fields = payload[0];
+    size_t pos = 1;
+
+    for (int bit = 0; bit < 8; bit++) {
+        if (!(fields & (1u << bit))) continue;
+        const CanField *f = &v2_fields[bit];
+        if (pos + f->wire_size > len) return false;
+
+        uint32_t value = 0;
+        for (int i = 0; i < f->wire_size; i++) value = (value << 8) | payload[pos + i];
+        pos += f->wire_size;
+        if (f->is_signed && f->wire_size < 4 && (value & (1u << (f->wire_size * 8 - 1)))) {
+            value |= ~0u << (f->wire_size * 8); //sign extend
+        }
+
+        uint8_t *dst = (uint8_t *)out + f->offset;
+        if (f->field_size == 2) {
+            uint16_t v16 = (uint16_t)value;
+            memcpy(dst, &v16, sizeof(v16));
+        } else {
+            memcpy(dst, &value, sizeof(value));
+        }
+    }
+    out->fields = fields;
+    return true;
+}
+
+static bool count_sequence(CanDecoder *dec, int slot, uint8_t seq) { //false for a repeat of the last message
+    CanNodeStats *st = &dec->stats[slot];
+    if (st->have_seq && seq == st->last_seq) { //a resent message that made it the first time
+        st->repeats++;
+        return false;
+    }
+    if (st->have_seq) {
+        uint8_t gap = (seq - st->last_seq - 1) & 0x0F; //a pod restart also shows up as a gap
+        st->lost += gap;
+        dec->lost_total += gap;
+    }
+    st->last_seq = seq;
+    st->have_seq = true;
+    st->messages++;
+    return true;
+}
+
+static CanDecodeResult feed_v2(CanDecoder *dec, int slot, uint8_t dlc, const uint8_t *data, SensorData *out) {
+    CanReassembly *rx = &dec->rx[slot];
+    if (dlc < 1 || dlc > 8) return CAN_DECODE_REJECTED;
+    uint8_t type = data[0] >> 4;
+    uint8_t low = data[0] & 0x0F;
+
+    if (type == FRAME_SINGLE) {
+        if (rx->len != 0) dec->stats[slot].errors++; //a single frame cuts off an unfinished message
+        rx->len = 0;
+        if (!decode_v2_payload(data + 1, dlc - 1, out)) return CAN_DECODE_REJECTED;
+        out->seq = low;
+        return count_sequence(dec, slot, low) ? CAN_DECODE_SAMPLE : CAN_DECODE_REJECTED;
+    }
+
+    if (type == FRAME_FIRST) {
+        if (rx->len != 0) dec->stats[slot].errors++;
+        rx->len = 0;
+        if (dlc < 2 || data[1] <= 6 || data[1] > CAN_V2_MAX_PAYLOAD) return CAN_DECODE_REJECTED; //a first frame always needs a follow-up
+        rx->len = data[1];
+        rx->received = dlc - 2;
+        memcpy(rx->buf, data + 2, rx->received);
+        rx->next_index = 1;
+        rx->seq = low;
+        return CAN_DECODE_PENDING;
+    }
+
+    if (type != FRAME_CONSECUTIVE || rx->len == 0) return CAN_DECODE_REJECTED; //stray consecutive frame
+    if (low != rx->next_index) { //a frame went missing mid-message, drop the whole thing
+        dec->stats[slot].errors++;
+        rx->len = 0;
+        return CAN_DECODE_REJECTED;
+    }
+
+    size_t chunk = dlc - 1;
+    if (chunk > (size_t)(rx->len - rx->received)) chunk = rx->len - rx->received;
+    memcpy(rx->buf + rx->received, data + 1, chunk);
+    rx->received += chunk;
+    rx->next_index = (rx->next_index + 1) & 0x0F;
+    if (rx->received < rx->len) return CAN_DECODE_PENDING;
+
+    size_t len = rx->len;
+    rx->len = 0;
+    if (!decode_v2_payload(rx->buf, len, out)) {
+        dec->stats[slot].errors++;
+        return CAN_DECODE_REJECTED;
+    }
+    out->seq = rx->seq;
+    return count_sequence(dec, slot, rx->seq) ? CAN_DECODE_SAMPLE : CAN_DECODE_REJECTED;
+}
+
+CanDecodeResult can_decoder_feed(CanDecoder *dec, uint32_t id, bool extd, uint8_t dlc, const uint8_t *data, SensorData *out) {
+    int slot = can_node_slot(id);
+    if (slot < 0 || extd) return CAN_DECODE_REJECTED;
+
+    SensorData decoded = {0}; //out stays untouched unless a sample completes
+    CanDecodeResult result;
+    if (dec->protocol[slot] == CAN_PROTOCOL_V2) {
+        decoded = dec->last[slot]; //a v2 message only carries some fields, the others keep their last value
+        result = feed_v2(dec, slot, dlc, data, &decoded);
+        decoded.known |= decoded.fields;
+    } else {
+        result = decode_v1(dlc, data, &decoded) ? CAN_DECODE_SAMPLE : CAN_DECODE_REJECTED;
+    }
+    if (result != CAN_DECODE_SAMPLE) return result;
+
+    decoded.temperature = decoded.temperature_raw / 10.0f;
+    decoded.raw_id = id;
+    decoded.node = (uint8_t)slot;
+    dec->last[slot] = decoded;
+    *out = decoded;
+    return CAN_DECODE_SAMPLE;
+}
+
+size_t can_v2_encode(const SensorData *data, uint8_t fields, uint8_t seq, uint8_t frames[][8], uint8_t *dlcs, size_t max_frames) {
+    uint8_t payload[CAN_V2_MAX_PAYLOAD];
+    size_t len = 0;
+    payload[len++] = fields;
+
+    for (int bit = 0; bit < 8; bit++) {
+        if (!(fields & (1u << bit))) continue;
+        const CanField *f = &v2_fields[bit];
+        const uint8_t *src = (const uint8_t *)data + f->offset;
+        uint32_t value;
+        if (f->field_size == 2) {
+            uint16_t v16;
+            memcpy(&v16, src, sizeof(v16));
+            value = v16;
+        } else {
+            memcpy(&value, src, sizeof(value));
+        }
+        for (int i = f->wire_size - 1; i >= 0; i--) payload[len++] = (uint8_t)(value >> (i * 8));
+    }
+
+    seq &= 0x0F;
+    if (len <= 7) {
+        if (max_frames < 1) return 0;
+        frames[0][0] = (FRAME_SINGLE << 4) | seq;
+        memcpy(&frames[0][1], payload, len);
+        dlcs[0] = len + 1;
+        return 1;
+    }
+
+    size_t needed = 1 + (len - 6 + 6) / 7; //first frame carries 6 bytes, consecutive ones 7
+    if (needed > max_frames) return 0;
+    frames[0][0] = (FRAME_FIRST << 4) | seq;
+    frames[0][1] = (uint8_t)len;
+    memcpy(&frames[0][2], payload, 6);
+    dlcs[0] = 8;
+
+    size_t pos = 6;
+    for (size_t n = 1; n < needed; n++) {
+        size_t chunk = (len - pos < 7) ? len - pos : 7;
+        frames[n][0] = (FRAME_CONSECUTIVE << 4) | (n & 0x0F);
+        memcpy(&frames[n][1], payload + pos, chunk);
+        dlcs[n] = chunk + 1;
+        pos += chunk;
+    }
+    return needed;
+}
+
+void can_resend_request_encode(uint16_t node_mask, uint8_t data[2]) {
+    data[0] = node_mask >> 8;
+    data[1] = node_mask & 0xFF;
+}
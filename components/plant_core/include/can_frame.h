@@ -0,0 +1,90 @@
+#ifndef CAN_FRAME_H
+#define CAN_FRAME_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "constants.h"
+#include "plant_types.h"
+
+//registry of the CAN sensor pods on the bus, the index of a node is its plant slot
+#define CAN_NODE_COUNT (sizeof((uint32_t[])CAN_NODE_IDS) / sizeof(uint32_t))
+
+_Static_assert(CAN_NODE_COUNT <= CAN_MAX_NODES, "too many entries in CAN_NODE_IDS");
+_Static_assert(sizeof((uint8_t[])CAN_NODE_PROTOCOLS) == CAN_NODE_COUNT, "CAN_NODE_PROTOCOLS needs one entry per node");
+
+extern const uint32_t can_node_ids[CAN_NODE_COUNT];
+
+int can_node_slot(uint32_t can_id); //returns -1 for frames that don't belong to a registered node
+
+//payload formats, picked per node with CAN_NODE_PROTOCOLS. all values are big endian.
+//
+//v1: one 8 byte frame, temperature (int16, deci-degrees C), light, humidity, moisture (uint16 each).
+//
+//v2: a message is split into frames ISO-TP style, the upper nibble of byte 0 is the frame type:
+//  single      0x0S  payload[1..7]                 S = message sequence, payload length from the DLC
+//  first       0x1S  total_len  payload[0..5]      S = message sequence, total_len up to CAN_V2_MAX_PAYLOAD
+//  consecutive 0x2N  payload[...7 bytes]           N = frame index 1, 2, ... (mod 16)
+//the reassembled payload is a field bitmap byte followed by the present fields in bit order,
+//sized as in the table below. a sequence gap between complete messages counts as lost messages.
+//fields left out of a message keep the node's previous value in the sample, SensorData.known has the bits
+//of every field the pod sent at least once. a field it never sent stays 0 with its bit clear.
+//
+//resend request, hub -> pods: ID CAN_RESEND_REQUEST_ID, dlc 2, a big endian bitmap of node slots. every pod in it
+//sends its newest message again, v2 pods with the same sequence number so the decoder drops a copy it already has.
+//the hub asks after waking from light sleep, the frame that woke it never reached TWAI.
+#define CAN_PROTOCOL_V1 1
+#define CAN_PROTOCOL_V2 2
+#define CAN_V2_MAX_PAYLOAD 32
+
+#define CAN_FIELD_TEMPERATURE (1u << 0) //int16, deci-degrees C
+#define CAN_FIELD_LIGHT (1u << 1) //uint16, lux
+#define CAN_FIELD_HUMIDITY (1u << 2) //uint8, %
+#define CAN_FIELD_MOISTURE (1u << 3) //uint16, raw
+#define CAN_FIELD_EC (1u << 4) //uint16, uS/cm
+#define CAN_FIELD_PH (1u << 5) //uint16, pH * 100
+#define CAN_FIELD_CO2 (1u << 6) //uint16, ppm
+#define CAN_FIELD_NODE_TIME (1u << 7) //uint32, pod uptime in ms
+#define CAN_FIELDS_V1 (CAN_FIELD_TEMPERATURE | CAN_FIELD_LIGHT | CAN_FIELD_HUMIDITY | CAN_FIELD_MOISTURE)
+
+typedef enum {
+    CAN_DECODE_REJECTED = -1, //unregistered ID, extended, malformed or out of order frame
+    CAN_DECODE_PENDING, //part of a multi-frame message, nothing to report yet
+    CAN_DECODE_SAMPLE, //out holds a complete sample
+} CanDecodeResult;
+
+typedef struct {
+    uint8_t buf[CAN_V2_MAX_PAYLOAD];
+    uint8_t len; //expected payload length, 0 when no message is in progress
+    uint8_t received;
+    uint8_t next_index; //index the next consecutive frame has to carry
+    uint8_t seq;
+} CanReassembly;
+
+typedef struct {
+    uint32_t messages;
+    uint32_t lost; //messages missing from the sequence
+    uint32_t repeats; //answers to a resend request that were already received
+    uint32_t errors; //malformed frames and broken reassemblies
+    uint8_t last_seq;
+    bool have_seq;
+} CanNodeStats;
+
+typedef struct {
+    uint8_t protocol[CAN_NODE_COUNT]; //from CAN_NODE_PROTOCOLS
+    CanReassembly rx[CAN_NODE_COUNT];
+    CanNodeStats stats[CAN_NODE_COUNT];
+    SensorData last[CAN_NODE_COUNT]; //newest sample per node, v2 messages are merged into it
+    uint32_t lost_total;
+} CanDecoder;
+
+void can_decoder_init(CanDecoder *dec);
+CanDecodeResult can_decoder_feed(CanDecoder *dec, uint32_t id, bool extd, uint8_t dlc, const uint8_t *data, SensorData *out);
+
+//pod side of v2, used by the host harness and as the reference for pod firmware.
+//returns the number of frames written (each 8 bytes, dlc in dlcs), 0 if the fields don't fit.
+size_t can_v2_encode(const SensorData *data, uint8_t fields, uint8_t seq, uint8_t frames[][8], uint8_t *dlcs, size_t max_frames);
+
+void can_resend_request_encode(uint16_t node_mask, uint8_t data[2]); //payload of a CAN_RESEND_REQUEST_ID frame
+
+#endif
@@ -0,0 +1,158 @@
+#ifndef CONSTANTS_H
+#define CONSTANTS_H
+
+#include "sdkconfig.h" //board and timing profile, "Plant controller" in menuconfig (components/plant_core/Kconfig.projbuild)
+
+//measurement calibration ratios
+#define PWM_LUX_RATIO 0.0256f //PWM lux ratio (to be updated)
+
+//lux per light intensity level, defaults from the timing profile, the "tune" command overrides them per board (main/tunables.h)
+#define LUX_TARGET_LOW CONFIG_PLANT_LUX_TARGET_LOW
+#define LUX_TARGET_MEDIUM CONFIG_PLANT_LUX_TARGET_MEDIUM
+#define LUX_TARGET_HIGH CONFIG_PLANT_LUX_TARGET_HIGH
+#define LUX_LEVELS 3
+
+//grow light output, levels go through a gamma table generated at build time (see main/CMakeLists.txt)
+#define LIGHT_LEVEL_MAX 1023 //full scale of the control level
+#define LIGHT_PWM_BITS 13 //LEDC duty resolution, 13 bits tops out just under 10kHz
+#define LIGHT_PWM_FREQ_HZ 5000
+#define LIGHT_GAMMA 2.2
+
+//grow light PID, gains in Q8 (256 = 1.0) per 10 second sample
+#define LIGHT_PID_KP_Q8 64
+#define LIGHT_PID_KI_Q8 128
+#define LIGHT_PID_KD_Q8 0
+#define LIGHT_PID_I_LIMIT 4000 //max integral correction in lux
+#define LIGHT_CAL_AUTO 1 //run the lux -> duty sweep on boot if no table is stored in NVS
+#define LIGHT_LUT_POINTS CONFIG_PLANT_LIGHT_LUT_POINTS //light level steps 0, 1/(n-1), ..., full
+
+//board pin map, picked by the board profile
+#define PUMP_PIN CONFIG_PLANT_PUMP_GPIO
+#define LIGHT_PIN CONFIG_PLANT_LIGHT_GPIO
+#define LIGHT_CHANNELS { {LIGHT_PIN, 256, 0} } //{gpio, spectrum share in Q8, fixture} per LEDC channel, a fixture's channels follow one level
+//#define LIGHT_CHANNELS { {LIGHT_PIN, 256, 0}, {38, 200, 0}, {39, 96, 0} } //white, red, blue rack
+#define WATER_LEVEL_PIN CONFIG_PLANT_WATER_LEVEL_GPIO
+#define CAN_TX_PIN CONFIG_PLANT_CAN_TX_GPIO
+#define CAN_RX_PIN CONFIG_PLANT_CAN_RX_GPIO
+
+//sensor filtering between CAN decode and control (sensor_filter.h), per field: temperature (deci C), light (lux), humidity (%RH), moisture (raw)
+#define SENSOR_FILTER_ENABLE 1
+#define SENSOR_FILTER_MEDIAN_N 5 //odd, frames per node in the median window
+#define SENSOR_FILTER_EMA_SHIFT { 2, 1, 2, 1 } //EMA weight 1/2^n, light stays quick for the PID and moisture for the pump threshold
+#define SENSOR_FILTER_REJECT { 30, 3000, 15, 150 } //jump from the filtered value the gate holds back
+#define SENSOR_FILTER_REJECT_MAX 3 //a jump seen this many frames in a row is real, the filter snaps to it
+
+//CAN bus
+#define CAN_BITRATE_KBPS 500 //125, 250, 500, 800 or 1000 (1 Mbit only for short racks, every pod has to match)
+#define CAN_RX_QUEUE_LEN (CAN_NODE_COUNT * 3 * 2) //frames buffered in the driver, a 3-frame v2 message (every field) from every node fits twice
+#define CAN_HEALTH_POLL_MS 1000 //longest a bus-off goes unnoticed while the bus is silent
+#define CAN_RECOVERY_RETRY_MS 5000 //bus-off recovery is retried this often if it doesn't finish
+
+//CAN sensor node registry, one plant per node (slot = position in the list)
+#define CAN_MAX_NODES 16
+#define CAN_NODE_IDS {0x101, 0x102, 0x103, 0x104, 0x105, 0x106, 0x107, 0x108}
+#define CAN_NODE_PROTOCOLS {1, 1, 1, 1, 1, 1, 1, 1} //payload format per node: 1 = fixed 8 bytes, 2 = sequenced/multi-frame (see can_frame.h)
+#define CAN_PRIMARY_NODE 0 //slot that feeds adafruit
+#define CAN_RESEND_REQUEST_ID 0x100 //hub -> pods resend request (can_frame.h), below every node ID so it wins arbitration
+
+//plant zones, each one is its own control loop with a sensor pod, pump and light fixture
+#define ZONE_TABLE { {CAN_PRIMARY_NODE, PUMP_PIN, 0} } //{CAN node slot, pump gpio, light fixture}
+//#define ZONE_TABLE { {0, PUMP_PIN, 0}, {1, 4, 1}, {2, 5, 2} } //three beds, one fixture each in LIGHT_CHANNELS
+#define ZONE_PUMPS_MAX_ON 1 //pumps running at once, sized to the pump supply
+#define ZONE_PUMP_START_GAP_US 2000000ULL //spacing between pump starts so inrush currents never stack
+
+//wall clock
+#define CLOCK_VALID_AFTER 1735689600 //2025-01-01 UTC, the clock counts as set (by SNTP or a warm boot) once it reads past this
+
+//wifi reconnects
+#define WIFI_BACKOFF_MIN_MS 500 //first retry after 250-500 ms, the window doubles per failure...
+#define WIFI_BACKOFF_MAX_MS 60000 //...up to one minute
+#define WIFI_CACHE_MAX_FAILS 3 //failed joins on the cached BSSID/channel before scanning every channel again
+#define WIFI_CACHE_STATIC_IP 0 //1 = reuse the last DHCP lease on boot, only for APs that hand out fixed leases
+#define WIFI_BOOT_WAIT_MS 10000 //upload task waits this long for the first join
+
+//adafruit transport (0 = HTTPS request per call, 1 = one persistent MQTT connection)
+#define ADA_TRANSPORT_MQTT 0
+#define ADA_MQTT_URI "mqtts://io.adafruit.com:8883"
+#define ADA_MQTT_KEEPALIVE_S 60
+#define ADA_MQTT_OUTBOX_LIMIT 8192 //bytes of unacked publishes kept for resend
+#define ADA_MQTT_PUBACK_WAIT_MS 5000 //a batch waits this long for its PUBACKs, what isn't acked stays in the offline log
+#define ADA_TLS_PIN_CA 1 //verify against main/certs/adafruit_io_ca.pem when it is built in, else the CA bundle
+
+//local HTTP/websocket API (local_api.h)
+#define LOCAL_API_ENABLE 1
+#define LOCAL_API_PORT 80
+#define LOCAL_API_MAX_CLIENTS 4 //open sockets, dashboards and one-off requests together
+#define LOCAL_API_BODY_MAX 256 //threshold writes, POST body or websocket message
+#define ADA_CLOUD_ENABLE 1 //0 = LAN only, no adafruit tasks or uploads
+
+//firmware updates (ota_update.h), the image is served at OTA_URL in secrets.h
+#define OTA_ENABLE 1
+#define OTA_CHECK_INTERVAL_MS 3600000 //hourly, an unchanged image costs one bodyless 304
+#define OTA_VALIDATE_TIMEOUT_MS 300000 //a new image gets 5 minutes to reach wifi (and the CAN bus) before it is rolled back
+#define OTA_VALIDATE_NEED_CAN 1 //0 = wifi alone proves the image, for benches without sensor pods
+
+//adafruit threshold polling, unchanged polls are answered with a bodyless 304 (mqtt gets pushed updates instead)
+#define ADA_THRESH_POLL_MS 5000
+
+//adafruit upload batching (0 = one group POST per sample)
+#define ADA_BATCH_MODE 1
+#define ADA_BATCH_MAX_SAMPLES 10 //flush once this many samples are queued...
+#define ADA_BATCH_MAX_AGE_US 60000000ULL //...or once the oldest one is 60 seconds old
+#define ADA_UPLOAD_QUEUE_LEN 16
+
+//adafruit report-on-change (upload_filter.h), each feed value sent is one data point off the account's rate limit
+//{deadband, deadband in % of the last sent value, heartbeat s} per feed: temperature (deci C), light (lux), humidity (%RH), moisture (raw), water level
+#define ADA_FEED_REPORT { {2, 0, 900}, {20, 5, 900}, {2, 0, 900}, {0, 2, 900}, {1, 0, 900} }
+#define ADA_RATE_POINTS_PER_MIN 30 //budget refill, the free adafruit tier allows 30 a minute per account
+#define ADA_RATE_BURST_POINTS 10 //budget cap, a change after a quiet spell goes out at once
+
+//store-and-forward log for uploads while offline
+#define UPLOAD_LOG_PARTITION_LABEL "upload_log"
+#define UPLOAD_LOG_PARTITION_SUBTYPE 0x40
+#define ADA_DRAIN_INTERVAL_US 10000000ULL //backlog check every 10 seconds after reconnecting, each pass sends what the rate budget holds
+
+//task layout (stack bytes, FreeRTOS priority). control and CAN RX are pinned to the app core, the network tasks to
+//the wifi core. control sits above lwip's tcpip task (18) but below esp_timer (22) and wifi (23), its steps take
+//microseconds so nothing else notices, and no amount of network traffic can hold back a pump edge.
+#define TASK_CONTROL_STACK 4096
+#define TASK_CONTROL_PRIO 19
+#define TASK_CAN_RX_STACK 4096
+#define TASK_CAN_RX_PRIO 17 //above the network tasks so frames are never left in the driver
+#define TASK_ADA_RX_STACK 8192
+#define TASK_ADA_TX_STACK 6144 //payloads are built in static buffers, TLS handshakes are what still needs the stack
+#define TASK_NET_PRIO 2
+#define TASK_OTA_STACK 8192 //the download runs its own TLS handshake
+
+//on-device sensor history
+#define SENSOR_HISTORY_LEN 1024 //frames kept in the ring buffer (10 bytes each), served at /api/history
+
+#define PUMP_RUN_TIME 5000000ULL //5 second pump run
+
+//pump dosing (pump_driver), the run time comes from the dose and each zone's flow calibration
+#define PUMP_DOSE_ML 100 //water per run, default for the "tune" command
+#define PUMP_COOLDOWN (CONFIG_PLANT_PUMP_COOLDOWN_S * 1000000ULL) //default from the timing profile, "tune" overrides it
+#define PUMP_FLOW_DEFAULT_UL_S 20000 //uncalibrated flow, 100 mL at 20 mL/s keeps the old 5 second run
+#define PUMP_RUN_MAX_US 60000000ULL //cap for a badly calibrated pump
+#define PUMP_SOFT_START_MS 0 //>0 ramps the motor up on LEDC over this long, needs a MOSFET driver rather than a relay
+#define PUMP_PWM_BITS 10
+#define PUMP_PWM_FREQ_HZ 20000 //above hearing, the motor doesn't whine during the ramp
+
+//low-power mode (needs CONFIG_PM_ENABLE and tickless idle, both set in sdkconfig)
+#define POWER_LOW_POWER_MODE 0 //1 = light sleep when idle and wifi modem sleep, for solar powered beds
+#define POWER_MAX_FREQ_MHZ 160
+#define POWER_MIN_FREQ_MHZ 40 //XTAL, the lowest the radio allows
+#define POWER_WIFI_LISTEN_INTERVAL 3 //wake for every 3rd DTIM beacon
+#define POWER_CAN_IDLE_MS 200 //bus quiet this long after a frame -> TWAI off, sleep until the next one
+#define POWER_AWAKE_UA 40000 //charge model for the per-sample estimate, measured on the bench
+#define POWER_ASLEEP_UA 1500 //light sleep with the station still associated
+#define POWER_REPORT_SAMPLES 30 //log the estimate every 30 samples
+
+//runtime diagnostics (latency histograms, counters, stack/heap watermarks)
+#define PERF_CONSOLE_ENABLE 1 //"stats" command on the UART console
+#define PERF_DIAG_FEED_ENABLE 0 //1 = also publish a compact report to the diagnostics feed
+#define PERF_DIAG_FEED "diagnostics" //created inside the data group
+#define PERF_DIAG_INTERVAL_US 600000000ULL //10 minutes, stays well under the adafruit throttle
+
+
+#endif
\ No newline at end of file
@@ -0,0 +1,45 @@
+#ifndef JSON_STREAM_H
+#define JSON_STREAM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//incremental, allocation-free JSON tokenizer. input can be fed in chunks of any size
+//(straight from esp_http_client_read), events come out through one callback.
+
+#define JSON_STREAM_KEY_MAX 24 //member names longer than this are truncated
+#define JSON_STREAM_VALUE_MAX 64 //scalar values longer than this are truncated
+#define JSON_STREAM_MAX_DEPTH 16
+
+typedef enum {
+    JSON_EVT_OBJECT_START,
+    JSON_EVT_OBJECT_END,
+    JSON_EVT_ARRAY_START,
+    JSON_EVT_ARRAY_END,
+    JSON_EVT_VALUE, //string contents (unescaped) or the raw text of a number/true/false/null
+} JsonEvent;
+
+//depth is the nesting level of the container being opened/closed, or the one holding the value.
+//key is the member name in front of it ("" inside arrays), value is only set for JSON_EVT_VALUE.
+typedef void (*json_stream_cb_t)(void *ctx, JsonEvent event, uint8_t depth, const char *key, const char *value);
+
+typedef struct {
+    json_stream_cb_t cb;
+    void *ctx;
+    uint8_t state;
+    uint8_t depth;
+    uint8_t unicode_left; //hex digits of a \uXXXX escape still to skip
+    bool expect_key;
+    bool error;
+    uint32_t array_bits; //bit n set when the container at depth n is an array
+    uint8_t key_len;
+    uint8_t value_len;
+    char key[JSON_STREAM_KEY_MAX + 1];
+    char value[JSON_STREAM_VALUE_MAX + 1];
+} JsonStream;
+
+void json_stream_init(JsonStream *js, json_stream_cb_t cb, void *ctx);
+bool json_stream_feed(JsonStream *js, const char *data, size_t len); //returns false once the input is malformed
+
+#endif
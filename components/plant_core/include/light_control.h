@@ -0,0 +1,42 @@
+#ifndef LIGHT_CONTROL_H
+#define LIGHT_CONTROL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "constants.h"
+
+//closed-loop grow light control: a lux -> level lookup table measured on the fixture gives the
+//feed-forward level, a fixed-point PID on top trims out ambient light and drift.
+
+typedef struct {
+    uint16_t level_max; //LIGHT_LEVEL_MAX the table was measured with
+    uint16_t lux[LIGHT_LUT_POINTS]; //measured lux at each level step, kept non-decreasing
+} LightLut;
+
+typedef struct {
+    int32_t integral_q8; //accumulated correction in lux, Q8
+    int32_t prev_lux; //last measurement, derivative is taken on it to avoid setpoint kicks
+    int32_t prev_target;
+    bool primed;
+} LightPid;
+
+typedef struct {
+    bool active;
+    bool started; //the fixture is being stepped, false while the sweep waits for the light window
+    uint8_t step; //level step currently on the fixture
+    uint16_t ambient; //lux read with the fixture off, taken off every point
+    LightLut lut; //filled in as the sweep goes
+} LightCalibration;
+
+void light_lut_default(LightLut *lut); //lux proportional to duty via PWM_LUX_RATIO, used until a sweep has run (light_lut_store.h persists measured ones)
+uint32_t light_lut_level_for_lux(const LightLut *lut, int32_t lux);
+
+void light_pid_reset(LightPid *pid);
+uint32_t light_pid_update(LightPid *pid, const LightLut *lut, int32_t target_lux, int32_t measured_lux); //returns the light level
+
+//on-device sweep: steps the fixture through every LUT point, one fresh lux reading per point. the table holds
+//the fixture's own light, the level 0 reading is ambient and is subtracted from the rest
+uint32_t light_cal_start(LightCalibration *cal); //returns the first level, the first step only switches to it
+bool light_cal_step(LightCalibration *cal, int32_t measured_lux, uint32_t *level); //true once the table is complete
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef PLANT_CONTROL_H
+#define PLANT_CONTROL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include "constants.h"
+#include "plant_types.h"
+#include "light_control.h"
+
+//pump and grow light decisions for every plant zone, free of hardware and RTOS calls so the same
+//code runs on the board and in the host replay harness. the caller owns the clock and one wakeup timer.
+
+typedef struct {
+    uint8_t node; //CAN registry slot of the zone's sensor pod
+    uint8_t pump_gpio;
+    uint8_t light; //fixture index in LIGHT_CHANNELS
+} ZoneConfig;
+
+#define ZONE_COUNT (sizeof((ZoneConfig[])ZONE_TABLE) / sizeof(ZoneConfig))
+
+_Static_assert(ZONE_COUNT <= 32, "zone masks are 32 bit");
+
+extern const ZoneConfig zone_config[ZONE_COUNT];
+
+#define CTRL_EVT_SENSOR (1u << 0) //new CAN frame, the sensor mask says for which zones
+#define CTRL_EVT_TIMER (1u << 1) //the deadline returned by the last step is due
+#define CTRL_EVT_THRESHOLDS (1u << 4) //new thresholds or a water-now press
+#define CTRL_EVT_WATER_LEVEL (1u << 5) //float switch changed
+
+typedef struct { //structure of arrays, one entry per zone, a step walks each array front to back
+    int64_t pump_off_at[ZONE_COUNT]; //absolute us, 0 while the pump is off
+    int64_t cooldown_until[ZONE_COUNT]; //0 when not cooling down
+    int64_t light_edge_at[ZONE_COUNT]; //next light window edge, 0 until the clock is synced
+    uint32_t light_level[ZONE_COUNT]; //0..LIGHT_LEVEL_MAX
+    uint32_t pump_run_us[ZONE_COUNT]; //length of the next run, set by the caller from the dose and flow calibration
+    uint32_t lux_target[LUX_LEVELS]; //lux for light intensity 1..LUX_LEVELS, set by the caller from its tunables
+    int64_t pump_cooldown_us; //same
+    bool pump_on[ZONE_COUNT];
+    bool pump_waiting[ZONE_COUNT]; //wants to water, held back by the pump budget
+    LightPid pid[ZONE_COUNT];
+    LightLut lut[ZONE_COUNT];
+    LightCalibration cal[ZONE_COUNT];
+    int64_t last_pump_start;
+    uint8_t next_pump_zone; //budget is handed out round robin from here
+} PlantControl;
+
+typedef struct {
+    int64_t next_deadline_us; //absolute time to step again with CTRL_EVT_TIMER, 0 if nothing is scheduled
+    uint32_t lut_done; //bit per zone whose calibration sweep just finished, ctl->lut[zone] holds the table
+} PlantActions;
+
+void plant_control_init(PlantControl *ctl); //default LUT in every zone, load measured ones over it
+void plant_control_step(PlantControl *ctl, const SensorData *data, ThresholdData *thresh, uint32_t events, uint32_t sensor_mask,
+                        int64_t now_us, const struct tm *local_time, PlantActions *actions); //data and thresh are per zone
+int get_target_lux(const PlantControl *ctl, int level);
+
+#endif
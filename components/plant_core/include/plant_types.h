@@ -0,0 +1,41 @@
+#ifndef PLANT_TYPES_H
+#define PLANT_TYPES_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct {  
+    float temperature;
+    int16_t temperature_raw; //deci-degrees C as sent on the bus
+    uint16_t light_level;
+    uint16_t humidity;
+    uint16_t moisture;
+    uint16_t ec; //uS/cm, v2 pods only
+    uint16_t ph_centi; //pH * 100, v2 pods only
+    uint16_t co2; //ppm, v2 pods only
+    uint32_t node_time_ms; //pod uptime when it sampled, v2 pods only
+    uint8_t fields; //CAN_FIELD_* bits the pod sent in this message
+    uint8_t known; //CAN_FIELD_* bits holding a value, from this message or an earlier one
+    uint8_t seq; //message sequence number (4 bit), 0 for v1 pods
+    bool water_level;
+    uint32_t raw_id;      
+    uint8_t node; //registry slot of the sending CAN node
+} SensorData;
+
+typedef struct {
+    int light_intensity;
+    int moisture;
+    int temperature;
+    int on_off_toggle;
+    float light_hours;
+    int water_now;
+} ThresholdData;
+
+typedef struct {
+    SensorData data;
+    int64_t created_at; //unix time of the sample, 0 if SNTP hadn't synced yet
+    int64_t taken_us; //esp_timer time of the sample, dates it once the clock is set if created_at is still 0
+    uint8_t feeds; //bit per upload feed that changed enough to send (upload_filter.h)
+} UploadSample;
+
+#endif
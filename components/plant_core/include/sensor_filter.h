@@ -0,0 +1,36 @@
+#ifndef SENSOR_FILTER_H
+#define SENSOR_FILTER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "constants.h"
+#include "plant_types.h"
+
+//per-node smoothing between CAN decode and control. each field goes through a median of the last
+//SENSOR_FILTER_MEDIAN_N frames (kills single spikes), an outlier gate against the filtered value
+//(holds on a jump until it repeats, then snaps to it) and a fixed-point EMA. the float switch is never filtered.
+
+typedef enum {
+    SENSOR_FILTER_TEMPERATURE, //deci-degrees C
+    SENSOR_FILTER_LIGHT,
+    SENSOR_FILTER_HUMIDITY,
+    SENSOR_FILTER_MOISTURE,
+    SENSOR_FILTER_FIELD_COUNT
+} SensorFilterField;
+
+typedef struct {
+    int32_t window[SENSOR_FILTER_FIELD_COUNT][SENSOR_FILTER_MEDIAN_N]; //newest raw values, ring at pos
+    int32_t ema_q8[SENSOR_FILTER_FIELD_COUNT];
+    uint8_t outliers[SENSOR_FILTER_FIELD_COUNT]; //consecutive medians the gate held back
+    uint8_t pos[SENSOR_FILTER_FIELD_COUNT]; //fields only advance on frames that carry them
+    uint8_t primed; //bit per field, clear until a frame carrying it filled its window
+} SensorFilter;
+
+void sensor_filter_init(SensorFilter *filter);
+//filters data in place and returns how many fields the outlier gate held. fields with their bit in raw_fields
+//pass through untouched and the filter restarts from them (the light calibration sweep needs raw lux).
+//a field missing from data->fields doesn't move its window, it reads back as the current filtered value
+int sensor_filter_apply(SensorFilter *filter, SensorData *data, uint32_t raw_fields);
+int32_t sensor_filter_median(const int32_t *values, int count);
+
+#endif
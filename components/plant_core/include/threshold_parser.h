@@ -0,0 +1,50 @@
+#ifndef THRESHOLD_PARSER_H
+#define THRESHOLD_PARSER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "json_stream.h"
+#include "plant_types.h"
+
+//single-pass parser for the adafruit thresholds group response (GET /groups/<key>).
+//matches each object in "feeds" by its key/name and applies its last_value to a ThresholdData.
+//the flat variant takes one object keyed by feed, {"moisture": 450, "light-hours": "12"}, as the local API sends it.
+
+#define THRESHOLD_VALUE_MAX 24
+#define THRESHOLD_FEED_COUNT 6
+
+extern const char *const threshold_feed_keys[THRESHOLD_FEED_COUNT]; //feed keys in the thresholds group, without the group prefix
+
+enum { //index of each feed in threshold_feed_keys
+    THRESH_LIGHT_INTENSITY,
+    THRESH_MOISTURE,
+    THRESH_TEMPERATURE,
+    THRESH_ON_OFF_TOGGLE,
+    THRESH_LIGHT_HOURS,
+    THRESH_WATER_NOW,
+    THRESH_COUNT
+};
+
+typedef struct {
+    JsonStream json;
+    ThresholdData *out;
+    uint8_t feeds_depth; //depth of the "feeds" array, 0 while outside it
+    int8_t feed; //threshold matched by the current feed object, -1 if none
+    bool have_value;
+    bool flat; //top level members are the feeds
+    uint8_t applied; //number of feeds written to out
+    uint8_t applied_feeds; //bit per threshold_feed_keys entry written to out
+    char last_value[THRESHOLD_VALUE_MAX + 1];
+} ThresholdParser;
+
+void threshold_parser_init(ThresholdParser *parser, ThresholdData *out);
+void threshold_parser_init_flat(ThresholdParser *parser, ThresholdData *out);
+bool threshold_parser_feed(ThresholdParser *parser, const char *data, size_t len);
+int threshold_parser_finish(ThresholdParser *parser); //returns how many thresholds were updated, -1 on malformed input
+
+int threshold_feed_index(const char *name); //index into threshold_feed_keys for "<feed>" or "<group>.<feed>", -1 if unknown
+bool threshold_apply_value(ThresholdData *thresh, int feed, const char *val); //false if feed is out of range
+int threshold_format_value(const ThresholdData *thresh, int feed, char *buf, size_t len); //as the feed holds it, -1 if feed is out of range
+void threshold_copy_value(ThresholdData *dst, const ThresholdData *src, int feed);
+
+#endif
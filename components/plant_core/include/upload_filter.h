@@ -0,0 +1,29 @@
+#ifndef UPLOAD_FILTER_H
+#define UPLOAD_FILTER_H
+
+#include <stdint.h>
+#include "plant_types.h"
+
+//report-on-change for the cloud feeds. a feed value goes out when it moved past its deadband from the
+//value last sent, or when its heartbeat runs out, so a quiet bed costs a handful of data points an hour.
+//everything sent is paid for from a data point budget that refills at ADA_RATE_POINTS_PER_MIN.
+
+#define UPLOAD_FEED_COUNT 5 //temperature, light, humidity, moisture, water level
+#define UPLOAD_FEEDS_ALL ((1u << UPLOAD_FEED_COUNT) - 1)
+
+typedef struct {
+    int32_t sent[UPLOAD_FEED_COUNT]; //value as last sent, in upload_feed_value units
+    int64_t sent_at[UPLOAD_FEED_COUNT]; //us, 0 until the feed was first sent
+    int64_t budget_at; //the budget holds (now - budget_at) / point interval data points, capped at the burst
+} UploadFilter;
+
+void upload_filter_init(UploadFilter *filter);
+int32_t upload_feed_value(const SensorData *data, int feed); //deci C, lux, %RH, raw moisture, 0/1, same order as the feeds
+uint8_t upload_filter_check(UploadFilter *filter, const SensorData *data, int64_t now_us); //feeds to send now, 0 for none, counted as sent.
+//a feed whose CAN field is clear in data->known is never picked
+
+//for data points sent without upload_filter_check, the offline backlog. they come out of the same budget
+int upload_filter_budget(UploadFilter *filter, int64_t now_us); //data points that can go out now
+void upload_filter_charge(UploadFilter *filter, int points); //no more than upload_filter_budget returned
+
+#endif
@@ -0,0 +1,139 @@
+#include "json_stream.h"
+#include <string.h>
+
+enum {
+    ST_IDLE, //between tokens
+    ST_STRING,
+    ST_STRING_ESCAPE,
+    ST_LITERAL,
+};
+
+void json_stream_init(JsonStream *js, json_stream_cb_t cb, void *ctx) {
+    memset(js, 0, sizeof(*js));
+    js->cb = cb;
+    js->ctx = ctx;
+}
+
+static bool in_array(const JsonStream *js) {
+    return js->depth > 0 && (js->array_bits & (1UL << js->depth));
+}
+
+static void push_char(JsonStream *js, char c) {
+    if (js->expect_key) {
+        if (js->key_len < JSON_STREAM_KEY_MAX) js->key[js->key_len++] = c;
+    } else {
+        if (js->value_len < JSON_STREAM_VALUE_MAX) js->value[js->value_len++] = c;
+    }
+}
+
+static void emit_value(JsonStream *js) {
+    js->value[js->value_len] = '\0';
+    js->cb(js->ctx, JSON_EVT_VALUE, js->depth, in_array(js) ? "" : js->key, js->value);
+    js->value_len = 0;
+}
+
+static void open_container(JsonStream *js, bool is_array) {
+    if (js->depth + 1 >= JSON_STREAM_MAX_DEPTH) {
+        js->error = true;
+        return;
+    }
+    js->depth++;
+    if (is_array) js->array_bits |= (1UL << js->depth);
+    else js->array_bits &= ~(1UL << js->depth);
+
+    const char *key = (js->depth > 1 && !(js->array_bits & (1UL << (js->depth - 1)))) ? js->key : "";
+    js->cb(js->ctx, is_array ? JSON_EVT_ARRAY_START : JSON_EVT_OBJECT_START, js->depth, key, NULL);
+
+    js->expect_key = !is_array;
+    js->key_len = 0;
+    js->key[0] = '\0';
+}
+
+static void close_container(JsonStream *js, bool is_array) {
+    if (js->depth == 0 || in_array(js) != is_array) {
+        js->error = true;
+        return;
+    }
+    js->cb(js->ctx, is_array ? JSON_EVT_ARRAY_END : JSON_EVT_OBJECT_END, js->depth, "", NULL);
+    js->depth--;
+    js->expect_key = false;
+}
+
+static void idle_char(JsonStream *js, char c) {
+    switch (c) {
+        case ' ': case '\t': case '\r': case '\n': case ':':
+            break;
+        case ',':
+            js->expect_key = !in_array(js); //next member name, an array just gets another value
+            break;
+        case '{': open_container(js, false); break;
+        case '[': open_container(js, true); break;
+        case '}': close_container(js, false); break;
+        case ']': close_container(js, true); break;
+        case '"':
+            if (js->expect_key) js->key_len = 0;
+            js->value_len = 0;
+            js->state = ST_STRING;
+            break;
+        default: //number, true, false, null
+            js->value_len = 0;
+            push_char(js, c);
+            js->state = ST_LITERAL;
+            break;
+    }
+}
+
+bool json_stream_feed(JsonStream *js, const char *data, size_t len) {
+    for (size_t i = 0; i < len && !js->error; i++) {
+        char c = data[i];
+
+        switch (js->state) {
+            case ST_IDLE:
+                idle_char(js, c);
+                break;
+
+            case ST_STRING:
+                if (js->unicode_left > 0) { //\uXXXX is not needed for feed data, it becomes '?'
+                    if (--js->unicode_left == 0) push_char(js, '?');
+                } else if (c == '\\') {
+                    js->state = ST_STRING_ESCAPE;
+                } else if (c == '"') {
+                    js->state = ST_IDLE;
+                    if (js->expect_key) {
+                        js->key[js->key_len] = '\0';
+                        js->expect_key = false;
+                    } else {
+                        emit_value(js);
+                    }
+                } else {
+                    push_char(js, c);
+                }
+                break;
+
+            case ST_STRING_ESCAPE:
+                js->state = ST_STRING;
+                switch (c) {
+                    case 'n': push_char(js, '\n'); break;
+                    case 't': push_char(js, '\t'); break;
+                    case 'r': push_char(js, '\r'); break;
+                    case 'b': push_char(js, '\b'); break;
+                    case 'f': push_char(js, '\f'); break;
+                    case 'u': js->unicode_left = 4; break;
+                    default: push_char(js, c); break; //quote, backslash, slash
+                }
+                break;
+
+            case ST_LITERAL:
+                if (c == ',' || c == '}' || c == ']' || c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+                    js->state = ST_IDLE;
+                    emit_value(js);
+                    idle_char(js, c); //the delimiter still has to be handled
+                } else {
+                    push_char(js, c);
+                }
+                break;
+        }
+    }
+
+    return !js->error;
+}
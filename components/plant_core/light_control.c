@@ -0,0 +1,105 @@
+#include "light_control.h"
+#include <math.h>
+#include <string.h>
+#include "constants.h"
+
+static uint32_t step_level(int step) {
+    return (uint32_t)step * LIGHT_LEVEL_MAX / (LIGHT_LUT_POINTS - 1);
+}
+
+void light_lut_default(LightLut *lut) {
+    lut->level_max = LIGHT_LEVEL_MAX;
+    for (int i = 0; i < LIGHT_LUT_POINTS; i++) {
+        float duty = powf((float)step_level(i) / LIGHT_LEVEL_MAX, LIGHT_GAMMA); //lux follows duty, not level: same curve as the gamma table
+        uint32_t lux = (uint32_t)(duty * 255.0f / PWM_LUX_RATIO);
+        lut->lux[i] = (lux > UINT16_MAX) ? UINT16_MAX : lux;
+    }
+}
+
+uint32_t light_lut_level_for_lux(const LightLut *lut, int32_t lux) {
+    if (lux <= lut->lux[0]) return 0; //ambient alone is already enough
+    if (lux >= lut->lux[LIGHT_LUT_POINTS - 1]) return LIGHT_LEVEL_MAX;
+
+    int i = 1;
+    while (lut->lux[i] < lux) i++; //first point at or above the target
+
+    int32_t lo = lut->lux[i - 1];
+    int32_t hi = lut->lux[i];
+    uint32_t level_lo = step_level(i - 1);
+    if (hi == lo) return level_lo;
+    return level_lo + (uint32_t)((int64_t)(lux - lo) * (step_level(i) - level_lo) / (hi - lo)); //linear between points
+}
+
+void light_pid_reset(LightPid *pid) {
+    memset(pid, 0, sizeof(*pid));
+}
+
+uint32_t light_pid_update(LightPid *pid, const LightLut *lut, int32_t target_lux, int32_t measured_lux) {
+    if (target_lux <= 0) { //lights off, start from scratch next time
+        light_pid_reset(pid);
+        return 0;
+    }
+
+    int32_t error = target_lux - measured_lux;
+    int32_t derivative = measured_lux - pid->prev_lux;
+    bool settling = !pid->primed || target_lux != pid->prev_target; //reading still shows the old duty
+    pid->prev_lux = measured_lux;
+    pid->prev_target = target_lux;
+    pid->primed = true;
+
+    if (settling) { //feed-forward jumps straight to the new target, keep what the integral learned
+        return light_lut_level_for_lux(lut, target_lux + pid->integral_q8 / 256);
+    }
+
+    int32_t integral_q8 = pid->integral_q8 + LIGHT_PID_KI_Q8 * error;
+    if (integral_q8 > LIGHT_PID_I_LIMIT * 256) integral_q8 = LIGHT_PID_I_LIMIT * 256;
+    if (integral_q8 < -LIGHT_PID_I_LIMIT * 256) integral_q8 = -LIGHT_PID_I_LIMIT * 256;
+
+    int32_t pd_q8 = LIGHT_PID_KP_Q8 * error - LIGHT_PID_KD_Q8 * derivative;
+    int32_t command = target_lux + (pd_q8 + integral_q8) / 256; //lux the fixture should be driven to
+
+    int32_t lux_min = lut->lux[0];
+    int32_t lux_max = lut->lux[LIGHT_LUT_POINTS - 1];
+    if ((command > lux_max && error > 0) || (command < lux_min && error < 0)) {
+        command = target_lux + (pd_q8 + pid->integral_q8) / 256; //saturated, stop integrating (anti-windup)
+    } else {
+        pid->integral_q8 = integral_q8;
+    }
+
+    return light_lut_level_for_lux(lut, command);
+}
+
+uint32_t light_cal_start(LightCalibration *cal) {
+    memset(cal, 0, sizeof(*cal));
+    cal->active = true;
+    cal->lut.level_max = LIGHT_LEVEL_MAX;
+    return step_level(0);
+}
+
+bool light_cal_step(LightCalibration *cal, int32_t measured_lux, uint32_t *level) {
+    if (!cal->active) return false;
+    if (!cal->started) { //this reading still shows whatever was on before the sweep
+        cal->started = true;
+        *level = step_level(0);
+        return false;
+    }
+
+    if (measured_lux < 0) measured_lux = 0;
+    if (measured_lux > UINT16_MAX) measured_lux = UINT16_MAX;
+    if (cal->step == 0) cal->ambient = (uint16_t)measured_lux;
+    measured_lux -= cal->ambient;
+    if (measured_lux < 0) measured_lux = 0;
+    if (cal->step > 0 && measured_lux < cal->lut.lux[cal->step - 1]) {
+        measured_lux = cal->lut.lux[cal->step - 1]; //noise can't make the table go backwards
+    }
+    cal->lut.lux[cal->step] = (uint16_t)measured_lux;
+
+    if (++cal->step >= LIGHT_LUT_POINTS) {
+        cal->active = false;
+        cal->started = false;
+        *level = 0;
+        return true;
+    }
+    *level = step_level(cal->step);
+    return false;
+}
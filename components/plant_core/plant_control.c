@@ -0,0 +1,179 @@
+#include "plant_control.h"
+#include <string.h>
+#include "can_frame.h"
+
+const ZoneConfig zone_config[ZONE_COUNT] = ZONE_TABLE;
+
+int get_target_lux(const PlantControl *ctl, int level) {
+    if (level >= 1 && level <= LUX_LEVELS) return (int)ctl->lux_target[level - 1];
+    return 0; //turns light off if illegal value
+}
+
+void plant_control_init(PlantControl *ctl) {
+    memset(ctl, 0, sizeof(*ctl));
+    for (int z = 0; z < (int)ZONE_COUNT; z++) {
+        light_lut_default(&ctl->lut[z]);
+        ctl->pump_run_us[z] = PUMP_RUN_TIME;
+    }
+    ctl->lux_target[0] = LUX_TARGET_LOW;
+    ctl->lux_target[1] = LUX_TARGET_MEDIUM;
+    ctl->lux_target[2] = LUX_TARGET_HIGH;
+    ctl->pump_cooldown_us = PUMP_COOLDOWN;
+}
+
+static bool due(int64_t deadline, int64_t now_us) {
+    return deadline != 0 && deadline <= now_us;
+}
+
+static void earliest(int64_t *next, int64_t deadline) {
+    if (deadline != 0 && (*next == 0 || deadline < *next)) *next = deadline;
+}
+
+static void stop_pump(PlantControl *ctl, int z, int64_t now_us) {
+    ctl->pump_on[z] = false;
+    ctl->pump_off_at[z] = 0;
+    ctl->cooldown_until[z] = now_us + ctl->pump_cooldown_us;
+}
+
+static void light_window(const ThresholdData *thresh, int64_t *start_s, int64_t *end_s) { //seconds since midnight
+    float start_hour = 8.0f; // 8:00am start time
+    float end_hour = start_hour + thresh->light_hours;
+    *start_s = (int64_t)(start_hour * 3600.0f);
+    *end_s = (int64_t)(end_hour * 3600.0f);
+}
+
+static bool clock_synced(const struct tm *local_time) { //seconds from the fields, mktime's zone lookup costs more than the whole step
+    int64_t years = local_time->tm_year - 70;
+    int64_t days = years * 365 + (years + 1) / 4 + local_time->tm_yday; //leap days up to 2100, off by the zone offset at most
+    int64_t secs = days * 86400 + local_time->tm_hour * 3600 + local_time->tm_min * 60 + local_time->tm_sec;
+    return secs > CLOCK_VALID_AFTER;
+}
+
+static bool light_window_open(const ThresholdData *thresh, const struct tm *local_time) {
+    int64_t now_s = local_time->tm_hour * 3600 + local_time->tm_min * 60 + local_time->tm_sec;
+    int64_t start_s, end_s;
+    light_window(thresh, &start_s, &end_s);
+
+    //ensure time has synced through Wi-Fi and time is within window
+    return clock_synced(local_time) && now_s >= start_s && now_s < end_s;
+}
+
+static void update_light(PlantControl *ctl, int z, const SensorData *data, const ThresholdData *thresh, bool new_data,
+                         int64_t now_us, const struct tm *local_time) {
+    int64_t now_s = local_time->tm_hour * 3600 + local_time->tm_min * 60 + local_time->tm_sec; //seconds since midnight
+    int64_t start_s, end_s;
+    light_window(thresh, &start_s, &end_s);
+
+    bool time_synced = clock_synced(local_time);
+    if (light_window_open(thresh, local_time)) {
+        int target_lux = get_target_lux(ctl, thresh->light_intensity);  //daytime logic
+        if (new_data && (data->fields & CAN_FIELD_LIGHT)) { //light can only be corrected against a fresh reading
+            ctl->light_level[z] = light_pid_update(&ctl->pid[z], &ctl->lut[z], target_lux, data->light_level); //feed-forward from the LUT plus PID trim
+        } else if (!(data->known & CAN_FIELD_LIGHT)) { //pod never sent lux, run open loop off the LUT
+            ctl->light_level[z] = light_lut_level_for_lux(&ctl->lut[z], target_lux);
+        }
+    } else {
+        ctl->light_level[z] = 0; //nighttime
+        light_pid_reset(&ctl->pid[z]);
+    }
+
+    ctl->light_edge_at[z] = 0;
+    if (time_synced) { //wake up at the next window edge instead of waiting for a frame
+        int64_t edge_s;
+        if (now_s < start_s) edge_s = start_s - now_s;
+        else if (now_s < end_s) edge_s = ((end_s < 24 * 3600) ? end_s : 24 * 3600) - now_s; //a window past midnight is cut there
+        else edge_s = 24 * 3600 - now_s + start_s; //tomorrow's start
+        ctl->light_edge_at[z] = now_us + edge_s * 1000000LL;
+    }
+}
+
+void plant_control_step(PlantControl *ctl, const SensorData *data, ThresholdData *thresh, uint32_t events, uint32_t sensor_mask,
+                        int64_t now_us, const struct tm *local_time, PlantActions *actions) {
+    memset(actions, 0, sizeof(*actions));
+    if (!(events & CTRL_EVT_SENSOR)) sensor_mask = 0;
+
+    for (int z = 0; z < (int)ZONE_COUNT; z++) {
+        bool new_data = (sensor_mask & (1u << z)) != 0;
+
+        if (ctl->pump_on[z] && (due(ctl->pump_off_at[z], now_us) || !data[z].water_level)) { //run is over, or the reservoir ran dry mid-run
+            stop_pump(ctl, z, now_us);
+        }
+        if (due(ctl->cooldown_until[z], now_us)) { //pump cooldown over
+            ctl->cooldown_until[z] = 0;
+        }
+
+        if (thresh[z].on_off_toggle == 0) {
+            ctl->pump_on[z] = false;
+            ctl->pump_off_at[z] = 0;
+            ctl->pump_waiting[z] = false;
+            ctl->light_level[z] = 0;
+            light_pid_reset(&ctl->pid[z]);
+            continue;
+        }
+
+        if (data[z].raw_id == 0) continue; //ignore null data
+
+        bool light_events = due(ctl->light_edge_at[z], now_us) || (events & CTRL_EVT_THRESHOLDS);
+        bool window_open = light_window_open(&thresh[z], local_time);
+        if (ctl->cal[z].active && ctl->cal[z].started && !window_open) { //window closed mid-sweep, start over in the next one
+            light_cal_start(&ctl->cal[z]);
+        }
+        if (ctl->cal[z].active && window_open) { //calibration sweep owns the light until it is done, never lit outside the window
+            if (new_data && (data[z].fields & CAN_FIELD_LIGHT) && light_cal_step(&ctl->cal[z], data[z].light_level, &ctl->light_level[z])) {
+                ctl->lut[z] = ctl->cal[z].lut;
+                light_pid_reset(&ctl->pid[z]);
+                actions->lut_done |= 1u << z;
+            }
+            if (ctl->cal[z].active) light_events = false;
+        }
+        bool sweeping = ctl->cal[z].active && ctl->cal[z].started;
+
+        if ((new_data && !sweeping) || light_events) {
+            update_light(ctl, z, &data[z], &thresh[z], new_data, now_us, local_time);
+        }
+
+        if (thresh[z].water_now == 1) {  //manual override
+            if (data[z].water_level == true && !ctl->pump_on[z]) ctl->pump_waiting[z] = true;
+            thresh[z].water_now = 0;  //reset
+        }
+        else if (ctl->pump_on[z] == false && ctl->cooldown_until[z] == 0 && new_data == true) { //standard operation
+            if ((data[z].known & CAN_FIELD_MOISTURE) && (data[z].moisture < thresh[z].moisture) && (data[z].water_level == true)) { //no reading, no watering
+                ctl->pump_waiting[z] = true;
+            }
+        }
+    }
+
+    //pump budget: at most ZONE_PUMPS_MAX_ON running, starts spaced so their inrush never stacks
+    int pumps_on = 0;
+    for (int z = 0; z < (int)ZONE_COUNT; z++) pumps_on += ctl->pump_on[z];
+
+    bool waiting = false;
+    for (int i = 0; i < (int)ZONE_COUNT; i++) {
+        int z = (ctl->next_pump_zone + i) % ZONE_COUNT;
+        if (!ctl->pump_waiting[z]) continue;
+        if (!data[z].water_level) { //nothing to pump any more
+            ctl->pump_waiting[z] = false;
+            continue;
+        }
+        bool gap_ok = ctl->last_pump_start == 0 || now_us - ctl->last_pump_start >= (int64_t)ZONE_PUMP_START_GAP_US;
+        if (pumps_on >= ZONE_PUMPS_MAX_ON || !gap_ok) {
+            waiting = true;
+            continue;
+        }
+        ctl->pump_waiting[z] = false;
+        ctl->pump_on[z] = true;
+        ctl->pump_off_at[z] = now_us + ctl->pump_run_us[z];
+        ctl->last_pump_start = now_us;
+        ctl->next_pump_zone = (z + 1) % ZONE_COUNT;
+        pumps_on++;
+    }
+
+    int64_t next = 0;
+    for (int z = 0; z < (int)ZONE_COUNT; z++) {
+        earliest(&next, ctl->pump_off_at[z]);
+        earliest(&next, ctl->cooldown_until[z]);
+        earliest(&next, ctl->light_edge_at[z]);
+    }
+    if (waiting && pumps_on < ZONE_PUMPS_MAX_ON) earliest(&next, ctl->last_pump_start + ZONE_PUMP_START_GAP_US); //held back by the gap only
+    actions->next_deadline_us = next;
+}
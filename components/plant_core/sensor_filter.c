@@ -0,0 +1,98 @@
+#include "sensor_filter.h"
+#include <string.h>
+#include "can_frame.h"
+
+static const uint8_t ema_shift[SENSOR_FILTER_FIELD_COUNT] = SENSOR_FILTER_EMA_SHIFT;
+static const int32_t reject_band[SENSOR_FILTER_FIELD_COUNT] = SENSOR_FILTER_REJECT;
+static const uint8_t field_bit[SENSOR_FILTER_FIELD_COUNT] = { CAN_FIELD_TEMPERATURE, CAN_FIELD_LIGHT, CAN_FIELD_HUMIDITY, CAN_FIELD_MOISTURE };
+
+_Static_assert(SENSOR_FILTER_MEDIAN_N % 2 == 1 && SENSOR_FILTER_MEDIAN_N <= 15, "median window must be odd and small");
+
+void sensor_filter_init(SensorFilter *filter) {
+    memset(filter, 0, sizeof(*filter));
+}
+
+int32_t sensor_filter_median(const int32_t *values, int count) {
+    int32_t sorted[SENSOR_FILTER_MEDIAN_N];
+    if (count <= 0) return 0;
+    if (count > SENSOR_FILTER_MEDIAN_N) count = SENSOR_FILTER_MEDIAN_N;
+    for (int i = 0; i < count; i++) { //insertion sort, a handful of values
+        int32_t v = values[i];
+        int j = i;
+        while (j > 0 && sorted[j - 1] > v) {
+            sorted[j] = sorted[j - 1];
+            j--;
+        }
+        sorted[j] = v;
+    }
+    return sorted[count / 2];
+}
+
+static int32_t get_field(const SensorData *data, int field) {
+    switch (field) {
+        case SENSOR_FILTER_TEMPERATURE: return data->temperature_raw;
+        case SENSOR_FILTER_LIGHT: return data->light_level;
+        case SENSOR_FILTER_HUMIDITY: return data->humidity;
+        default: return data->moisture;
+    }
+}
+
+static void set_field(SensorData *data, int field, int32_t value) {
+    switch (field) {
+        case SENSOR_FILTER_TEMPERATURE:
+            data->temperature_raw = (int16_t)value;
+            data->temperature = value / 10.0f;
+            break;
+        case SENSOR_FILTER_LIGHT: data->light_level = (uint16_t)value; break;
+        case SENSOR_FILTER_HUMIDITY: data->humidity = (uint16_t)value; break;
+        default: data->moisture = (uint16_t)value; break;
+    }
+}
+
+static int32_t ema_value(int32_t ema_q8) {
+    return (ema_q8 + 128) >> 8;
+}
+
+int sensor_filter_apply(SensorFilter *filter, SensorData *data, uint32_t raw_fields) {
+    int held = 0;
+
+    for (int f = 0; f < SENSOR_FILTER_FIELD_COUNT; f++) {
+        bool primed = (filter->primed & (1u << f)) != 0;
+        if (!(data->fields & field_bit[f])) { //not in this message, the value is the last one again
+            if (primed) set_field(data, f, ema_value(filter->ema_q8[f]));
+            continue;
+        }
+
+        int32_t raw = get_field(data, f);
+        filter->window[f][filter->pos[f]] = raw;
+        filter->pos[f] = (uint8_t)((filter->pos[f] + 1) % SENSOR_FILTER_MEDIAN_N);
+
+        if (!primed || (raw_fields & (1u << f))) { //start over from this frame, the window is filled with it
+            for (int i = 0; i < SENSOR_FILTER_MEDIAN_N; i++) filter->window[f][i] = raw;
+            filter->ema_q8[f] = raw * 256;
+            filter->outliers[f] = 0;
+            filter->primed |= 1u << f;
+            continue; //data keeps the raw value
+        }
+
+        int32_t median = sensor_filter_median(filter->window[f], SENSOR_FILTER_MEDIAN_N);
+        int32_t smoothed = ema_value(filter->ema_q8[f]);
+        int32_t jump = median - smoothed;
+        if (jump < 0) jump = -jump;
+
+        if (jump > reject_band[f]) {
+            if (++filter->outliers[f] < SENSOR_FILTER_REJECT_MAX) { //hold the last filtered value for now
+                held++;
+                set_field(data, f, smoothed);
+                continue;
+            }
+            filter->ema_q8[f] = median * 256; //it kept coming back, a real step: snap instead of crawling towards it
+        } else {
+            filter->ema_q8[f] += (median * 256 - filter->ema_q8[f]) >> ema_shift[f]; //arithmetic shift, rounds towards -inf
+        }
+        filter->outliers[f] = 0;
+        set_field(data, f, ema_value(filter->ema_q8[f]));
+    }
+
+    return held;
+}
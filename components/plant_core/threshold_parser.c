@@ -0,0 +1,131 @@
+#include "threshold_parser.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+_Static_assert(THRESH_COUNT == THRESHOLD_FEED_COUNT, "threshold feed table out of sync");
+
+const char *const threshold_feed_keys[THRESHOLD_FEED_COUNT] = {
+    "light-intensity", "moisture", "temperature", "on-off-toggle", "light-hours", "water-now"
+};
+
+int threshold_feed_index(const char *name) {
+    const char *dot = strrchr(name, '.'); //group feed keys look like "<group>.<feed>"
+    if (dot != NULL) name = dot + 1;
+
+    for (int i = 0; i < THRESH_COUNT; i++) {
+        if (strcmp(name, threshold_feed_keys[i]) == 0) return i;
+    }
+    return -1;
+}
+
+bool threshold_apply_value(ThresholdData *thresh, int feed, const char *val) {
+    switch (feed) {
+        case THRESH_LIGHT_INTENSITY: thresh->light_intensity = atoi(val); break;
+        case THRESH_MOISTURE: thresh->moisture = atoi(val); break;
+        case THRESH_TEMPERATURE: thresh->temperature = atoi(val); break;
+        case THRESH_ON_OFF_TOGGLE: //on
+            thresh->on_off_toggle = (strncmp(val, "ON", 2) == 0 || strncmp(val, "1", 1) == 0) ? 1 : 0;
+            break;
+        case THRESH_LIGHT_HOURS: thresh->light_hours = atof(val); break;
+        case THRESH_WATER_NOW: thresh->water_now = atoi(val); break;
+        default: return false;
+    }
+    return true;
+}
+
+int threshold_format_value(const ThresholdData *thresh, int feed, char *buf, size_t len) {
+    switch (feed) {
+        case THRESH_LIGHT_INTENSITY: return snprintf(buf, len, "%d", thresh->light_intensity);
+        case THRESH_MOISTURE: return snprintf(buf, len, "%d", thresh->moisture);
+        case THRESH_TEMPERATURE: return snprintf(buf, len, "%d", thresh->temperature);
+        case THRESH_ON_OFF_TOGGLE: return snprintf(buf, len, "%s", thresh->on_off_toggle ? "ON" : "OFF"); //the dashboard toggle's own values
+        case THRESH_LIGHT_HOURS: return snprintf(buf, len, "%g", thresh->light_hours);
+        case THRESH_WATER_NOW: return snprintf(buf, len, "%d", thresh->water_now);
+        default: return -1;
+    }
+}
+
+void threshold_copy_value(ThresholdData *dst, const ThresholdData *src, int feed) {
+    switch (feed) {
+        case THRESH_LIGHT_INTENSITY: dst->light_intensity = src->light_intensity; break;
+        case THRESH_MOISTURE: dst->moisture = src->moisture; break;
+        case THRESH_TEMPERATURE: dst->temperature = src->temperature; break;
+        case THRESH_ON_OFF_TOGGLE: dst->on_off_toggle = src->on_off_toggle; break;
+        case THRESH_LIGHT_HOURS: dst->light_hours = src->light_hours; break;
+        case THRESH_WATER_NOW: dst->water_now = src->water_now; break;
+        default: break;
+    }
+}
+
+static void on_json(void *ctx, JsonEvent event, uint8_t depth, const char *key, const char *value) {
+    ThresholdParser *parser = (ThresholdParser *)ctx;
+
+    switch (event) {
+        case JSON_EVT_ARRAY_START:
+            if (depth == 2 && strcmp(key, "feeds") == 0) parser->feeds_depth = depth;
+            break;
+
+        case JSON_EVT_ARRAY_END:
+            if (depth == parser->feeds_depth) parser->feeds_depth = 0;
+            break;
+
+        case JSON_EVT_OBJECT_START:
+            if (parser->feeds_depth != 0 && depth == parser->feeds_depth + 1) { //a new feed
+                parser->feed = -1;
+                parser->have_value = false;
+            }
+            break;
+
+        case JSON_EVT_OBJECT_END:
+            if (parser->feeds_depth != 0 && depth == parser->feeds_depth + 1 && parser->feed >= 0 && parser->have_value) {
+                if (threshold_apply_value(parser->out, parser->feed, parser->last_value)) { //key and last_value can come in either order, so apply at the end
+                    parser->applied++;
+                    parser->applied_feeds |= 1u << parser->feed;
+                }
+            }
+            break;
+
+        case JSON_EVT_VALUE:
+            if (parser->flat) {
+                int feed = threshold_feed_index(key);
+                if (depth == 1 && threshold_apply_value(parser->out, feed, value)) {
+                    parser->applied++;
+                    parser->applied_feeds |= 1u << feed;
+                }
+                break;
+            }
+            if (parser->feeds_depth == 0 || depth != parser->feeds_depth + 1) break; //only direct members of a feed
+
+            if (strcmp(key, "key") == 0 || (strcmp(key, "name") == 0 && parser->feed < 0)) {
+                int8_t match = (int8_t)threshold_feed_index(value);
+                if (match >= 0) parser->feed = match;
+            } else if (strcmp(key, "last_value") == 0) {
+                strncpy(parser->last_value, value, THRESHOLD_VALUE_MAX);
+                parser->last_value[THRESHOLD_VALUE_MAX] = '\0';
+                parser->have_value = strcmp(value, "null") != 0;
+            }
+            break;
+    }
+}
+
+void threshold_parser_init(ThresholdParser *parser, ThresholdData *out) {
+    memset(parser, 0, sizeof(*parser));
+    parser->out = out;
+    parser->feed = -1;
+    json_stream_init(&parser->json, on_json, parser);
+}
+
+void threshold_parser_init_flat(ThresholdParser *parser, ThresholdData *out) {
+    threshold_parser_init(parser, out);
+    parser->flat = true;
+}
+
+bool threshold_parser_feed(ThresholdParser *parser, const char *data, size_t len) {
+    return json_stream_feed(&parser->json, data, len);
+}
+
+int threshold_parser_finish(ThresholdParser *parser) {
+    if (parser->json.error || parser->json.depth != 0) return -1; //truncated or malformed
+    return parser->applied;
+}
@@ -0,0 +1,78 @@
+#include "upload_filter.h"
+#include "can_frame.h"
+#include "constants.h"
+
+typedef struct {
+    int32_t deadband; //in feed units
+    int32_t deadband_pct; //of the last sent value, the wider of the two applies
+    int32_t heartbeat_s; //sent at least this often however quiet the feed is
+} FeedReport;
+
+static const FeedReport feed_report[UPLOAD_FEED_COUNT] = ADA_FEED_REPORT;
+static const uint8_t feed_field[UPLOAD_FEED_COUNT] = { CAN_FIELD_TEMPERATURE, CAN_FIELD_LIGHT, CAN_FIELD_HUMIDITY, CAN_FIELD_MOISTURE, 0 }; //0: measured on the hub
+
+#define POINT_US (60000000LL / ADA_RATE_POINTS_PER_MIN)
+
+_Static_assert(ADA_RATE_BURST_POINTS >= UPLOAD_FEED_COUNT, "the burst must fit a full sample or heartbeats could stall");
+
+void upload_filter_init(UploadFilter *filter) {
+    for (int feed = 0; feed < UPLOAD_FEED_COUNT; feed++) {
+        filter->sent[feed] = 0;
+        filter->sent_at[feed] = 0;
+    }
+    filter->budget_at = INT64_MIN / 2; //starts full, clamped to the burst on the first check
+}
+
+int32_t upload_feed_value(const SensorData *data, int feed) {
+    switch (feed) {
+        case 0: return data->temperature_raw;
+        case 1: return data->light_level;
+        case 2: return data->humidity;
+        case 3: return data->moisture;
+        default: return data->water_level ? 1 : 0;
+    }
+}
+
+static int32_t magnitude(int32_t v) {
+    return (v < 0) ? -v : v;
+}
+
+uint8_t upload_filter_check(UploadFilter *filter, const SensorData *data, int64_t now_us) {
+    uint8_t feeds = 0;
+    int points = 0;
+
+    for (int feed = 0; feed < UPLOAD_FEED_COUNT; feed++) {
+        const FeedReport *report = &feed_report[feed];
+        if (feed_field[feed] && !(data->known & feed_field[feed])) continue; //the pod never sent it, nothing to report
+        int32_t value = upload_feed_value(data, feed);
+        bool due = filter->sent_at[feed] == 0 || now_us - filter->sent_at[feed] >= report->heartbeat_s * 1000000LL;
+
+        int32_t band = (int32_t)((int64_t)magnitude(filter->sent[feed]) * report->deadband_pct / 100);
+        if (band < report->deadband) band = report->deadband;
+        if (band < 1) band = 1; //any change at all
+        if (due || magnitude(value - filter->sent[feed]) >= band) {
+            feeds |= 1u << feed;
+            points++;
+        }
+    }
+    if (feeds == 0) return 0;
+    if (upload_filter_budget(filter, now_us) < points) return 0; //over budget, the values are still unsent and go out on a later frame
+
+    upload_filter_charge(filter, points);
+    for (int feed = 0; feed < UPLOAD_FEED_COUNT; feed++) {
+        if (!(feeds & (1u << feed))) continue;
+        filter->sent[feed] = upload_feed_value(data, feed);
+        filter->sent_at[feed] = now_us;
+    }
+    return feeds;
+}
+
+int upload_filter_budget(UploadFilter *filter, int64_t now_us) {
+    int64_t full_at = now_us - ADA_RATE_BURST_POINTS * POINT_US;
+    if (filter->budget_at < full_at) filter->budget_at = full_at; //a long quiet spell doesn't bank more than the burst
+    return (int)((now_us - filter->budget_at) / POINT_US);
+}
+
+void upload_filter_charge(UploadFilter *filter, int points) {
+    filter->budget_at += points * POINT_US;
+}
@@ -2,6 +2,7 @@
 #include <stdbool.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdatomic.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "driver/gpio.h"
@@ -9,73 +10,110 @@
 #include "driver/twai.h"
 #include "esp_log.h"
 #include "nvs_flash.h"
-#include "esp_netif.h"
-#include "esp_event.h"
-#include "esp_wifi.h"
-#include "esp_http_client.h"
-#include "esp_crt_bundle.h"
-#include "driver/ledc.h"
 #include "freertos/semphr.h"
+#include "freertos/queue.h"
 #include "constants.h"
+#include "plant_types.h"
+#include "can_nodes.h"
+#include "sensor_history.h"
+#include "shared_state.h"
+#include "plant_control.h"
+#include "light_lut_store.h"
+#include "light_output.h"
+#include "pump_driver.h"
+#include "power_mgmt.h"
+#include "upload_log.h"
+#include "upload_filter.h"
+#include "sensor_filter.h"
+#include "ada_transport.h"
+#include "threshold_parser.h"
+#include "perf_stats.h"
+#include "console_cmds.h"
+#include "wifi_link.h"
+#include "warm_boot.h"
+#include "local_api.h"
+#include "tunables.h"
+#include "ota_update.h"
 #include "secrets.h"
 #include <time.h>
 #include <sys/time.h>
 #include "esp_sntp.h"
 
-#define CAN_TX_PIN GPIO_NUM_17
-#define CAN_RX_PIN GPIO_NUM_18
+#define CONTROL_QUEUE_LEN 8 //decoded frames buffered between the CAN RX task and the control loop
 
-SemaphoreHandle_t threshold_mutex;
-SemaphoreHandle_t sensor_data_mutex;
-SemaphoreHandle_t tx_trigger_sem;
+typedef struct { //control loop events (CTRL_EVT_* in plant_control.h), the loop only wakes up for these
+    uint32_t events;
+    SensorData data; //valid with CTRL_EVT_SENSOR
+} ControlEvent;
 
-bool trigger_water_reset = false; 
-static const char *TAG = "PLANT_SYSTEM";
+QueueHandle_t control_queue;
+QueueHandle_t upload_queue; //samples waiting for adafruit_tx_task
 
-typedef struct {  
-    float temperature;
-    uint16_t light_level;
-    uint16_t humidity;
-    uint16_t moisture;
-    bool water_level;
-    uint32_t raw_id;      
-} SensorData;
+static const AdaTransport *ada_transport; //http or mqtt, see ADA_TRANSPORT_MQTT
 
-typedef struct {
-    int light_intensity;
-    int moisture;
-    int temperature;
-    int on_off_toggle;
-    float light_hours;
-    int water_now;
-} ThresholdData;
+static atomic_uint control_pending = 0; //events posted by timers/tasks, collected on the next wakeup
+static esp_timer_handle_t control_timer; //one-shot at the earliest pump, cooldown or light window deadline of any zone
+
+static PlantControl plant_control; //pump/light state, LUT and PID per zone, only touched by the control loop
+static bool zone_pump_output[ZONE_COUNT]; //level last written to each pump GPIO
+static UploadFilter upload_filter; //last value sent per feed and the data point budget, the backlog drain spends from it too
+static portMUX_TYPE upload_budget_lock = portMUX_INITIALIZER_UNLOCKED; //control task and adafruit_tx_task
+static SensorFilter sensor_filters[CAN_NODE_COUNT]; //median window and smoothed value per pod, only touched by the control loop
+
+atomic_bool trigger_water_reset = false; //set by the control loop, cleared by adafruit_tx_task once the feed is reset
+static atomic_uint lan_feeds_held = 0; //threshold feeds written over the LAN, cloud pulls keep the local value until they show it too
+static atomic_uint lan_feeds_unpushed = 0; //of those, the ones adafruit_tx_task still has to write to the cloud feeds
+static const char *TAG = "PLANT_SYSTEM";
 
 void hardware_init(void); //declaring functions
 void can_driver_init(void);
-bool can_driver_read_sensor(SensorData *out_data);
+void can_driver_deinit(void);
+void can_driver_check_health(void);
+void can_driver_request_resend(void);
+bool can_driver_read_sensor(SensorData *out_data, TickType_t timeout);
+void nvs_init(void);
 void wifi_init(void);
-void rtos_tasks_init(ThresholdData *thresh_data, SensorData *sensor_data);
-void publish_all_sensors(SensorData *data);
-void process_sensor_data(SensorData *data, bool *pump_state, uint32_t *light_pwm, ThresholdData *thresh, bool new_data);
-void update_hardware_actuators(bool pump_state, uint32_t light_pwm, bool new_data);
+void rtos_tasks_init(void);
+void rtos_tasks_start(void);
+void control_task(void *pvParameters);
+void process_sensor_data(SensorData *data, ThresholdData *thresh, uint32_t events, uint32_t sensor_mask);
+void update_hardware_actuators(void);
 bool read_water_level_sensor(void);
-void pull_adafruit_thresholds(ThresholdData *thresh);
-int get_target_lux(int level);
 void adafruit_rx_task(void *pvParameters);
 void adafruit_tx_task(void *pvParameters);
-ThresholdData get_safe_thresholds(ThresholdData *shared_thresh);
+void can_rx_task(void *pvParameters);
 void time_sync_init(void);
-void reset_water_now_feed(void);
+void control_timers_init(void);
+void control_post(uint32_t events);
+void control_post_from_isr(uint32_t events);
+static void on_water_level_change(void);
+static void on_local_thresholds(const ThresholdData *thresh, uint8_t feeds);
 
 void app_main(void) {
+    nvs_init(); //before anything that keeps settings in NVS
+    ota_update_boot_check(); //first boot of a new image starts its rollback timer
+    tunables_init();
     can_driver_init(); 
     hardware_init(); 
     wifi_init(); 
     time_sync_init();
+    warm_boot_restore_clock(); //lights follow the schedule right away after a brownout or crash, SNTP corrects the clock later
+
+    shared_state_init(); //one sensor/threshold slot per registered CAN node
+
+    plant_control_init(&plant_control);
+    upload_filter_init(&upload_filter);
+    for (int n = 0; n < (int)CAN_NODE_COUNT; n++) sensor_filter_init(&sensor_filters[n]);
+    for (int z = 0; z < (int)ZONE_COUNT; z++) { //fixture lux -> duty, from NVS or the default line
+        if (light_lut_load(z, &plant_control.lut[z]) == ESP_OK) {
+            printf("zone %d: loaded light calibration, full output %u lux\n", z, plant_control.lut[z].lux[LIGHT_LUT_POINTS - 1]);
+        } else if (LIGHT_CAL_AUTO) {
+            light_cal_start(&plant_control.cal[z]); //sweep runs on the CAN frames once the light window opens
+            printf("zone %d: no light calibration stored, starting sweep\n", z);
+        }
+    }
 
-    SensorData current_sensor_data = {0};
-    
-    ThresholdData current_thresholds = { //initialized with safe values (in case wifi drops)
+    ThresholdData default_thresholds = { //initialized with safe values (in case wifi drops)
         .light_intensity = 1,
         .moisture = 100,
         .temperature = 25,
@@ -83,148 +121,251 @@ void app_main(void) {
         .light_hours = 12.0,
         .water_now = 0
     };
+    if (warm_boot_load_thresholds(&default_thresholds)) { //the last thresholds from the cloud beat the defaults until the first pull
+        printf("thresholds restored from the last session\n");
+    }
+    shared_thresholds_write(-1, &default_thresholds);
 
-    bool is_pump_active = false;
-    uint32_t current_light_pwm = 0;
     //int64_t last_adafruit_post = 0;
     
     printf("system initialized, now listening for CANBUS messages\n");
 
-    rtos_tasks_init(&current_thresholds, &current_sensor_data);
+    control_timers_init();
+    rtos_tasks_init();
+    power_mgmt_init(on_water_level_change);
+    if (PERF_CONSOLE_ENABLE && !console_init()) {
+        printf("error: failed to start the serial console\n");
+    }
+    if (LOCAL_API_ENABLE && !local_api_start(on_local_thresholds)) {
+        printf("error: failed to start the local API\n");
+    }
+    rtos_tasks_start(); //app_main returns once the control, CAN and network tasks are up
+}
 
+void control_task(void *pvParameters) {
     while (1) {
-        int64_t current_time = esp_timer_get_time();
-        bool new_data_arrived;
-
-        new_data_arrived = false;
-        //pull_adafruit_thresholds(&current_thresholds);
-
-        ThresholdData local_thresholds = get_safe_thresholds(&current_thresholds);
-        SensorData temp_sensor_data = current_sensor_data;
-
-        if (can_driver_read_sensor(&temp_sensor_data)) {  //read sensor (non blocking)
+        uint32_t sensor_mask = 0; //zones with a fresh reading
+        ControlEvent evt;
+
+        if (xQueueReceive(control_queue, &evt, portMAX_DELAY) != pdTRUE) continue; //sleeps until a frame, timer or threshold change
+        int64_t wake_time = esp_timer_get_time();
+        warm_boot_clock_snapshot();
+        uint32_t events = (evt.events & CTRL_EVT_SENSOR) | atomic_exchange(&control_pending, 0);
+
+        if (events & CTRL_EVT_SENSOR) {
+            SensorData rx_data = evt.data;
+            rx_data.water_level = read_water_level_sensor();
+            sensor_history_push(&rx_data, esp_timer_get_time()); //every frame goes into history, before the limiter
+            local_api_publish_sensor(&rx_data); //and out to LAN dashboards as it arrives
+
+            if (SENSOR_FILTER_ENABLE) { //spikes and noise are taken out before uploads and control see the frame
+                uint32_t raw_fields = 0;
+                for (int z = 0; z < (int)ZONE_COUNT; z++) { //a light sweep needs the fixture's raw response
+                    if (zone_config[z].node == rx_data.node && plant_control.cal[z].active && plant_control.cal[z].started) raw_fields |= 1u << SENSOR_FILTER_LIGHT;
+                }
+                perf_count(PERF_SENSOR_OUTLIER, sensor_filter_apply(&sensor_filters[rx_data.node], &rx_data, raw_fields));
+            }
 
+            if (ADA_CLOUD_ENABLE && rx_data.node == CAN_PRIMARY_NODE) { //every frame is checked for uploads, so a fast change isn't held back by the limiter
+                UploadSample sample = { .data = rx_data, .created_at = 0, .taken_us = esp_timer_get_time() };
+                portENTER_CRITICAL(&upload_budget_lock);
+                sample.feeds = upload_filter_check(&upload_filter, &rx_data, esp_timer_get_time());
+                portEXIT_CRITICAL(&upload_budget_lock);
+                perf_count(PERF_UPLOAD_HELD, UPLOAD_FEED_COUNT - __builtin_popcount(sample.feeds));
+                if (sample.feeds != 0) {
+                    time_t now;
+                    time(&now);
+                    if (now > CLOCK_VALID_AFTER) sample.created_at = now; //only stamp once SNTP has set the clock
+
+                    if (xQueueSend(upload_queue, &sample, 0) != pdTRUE) {  //hand the sample to the uploader
+                        printf(" upload queue full, dropped sample\n");
+                    }
+                }
+            }
 
-            //-- This part limits inputs to only once per 10 seconds
-            static int64_t last_read_time = 0;
-            if (esp_timer_get_time() - last_read_time >= 10000000ULL) {
-                last_read_time = esp_timer_get_time();
+            //-- This part limits inputs to only once per 10 seconds (per node)
+            static int64_t last_read_time[CAN_NODE_COUNT] = {0};
+            if (esp_timer_get_time() - last_read_time[rx_data.node] >= 10000000ULL) {
+                last_read_time[rx_data.node] = esp_timer_get_time();
             //--
-            
-            new_data_arrived = true;
-            //current_sensor_data.water_level = read_water_level_sensor(); //reads water level
-            temp_sensor_data.water_level = read_water_level_sensor();
 
-            if (xSemaphoreTake(sensor_data_mutex, portMAX_DELAY)) {
-                current_sensor_data = temp_sensor_data;
-                xSemaphoreGive(sensor_data_mutex);
+            shared_sensor_write(rx_data.node, &rx_data);
+            for (int z = 0; z < (int)ZONE_COUNT; z++) {
+                if (zone_config[z].node == rx_data.node) sensor_mask |= 1u << z;
             }
             
-            xSemaphoreGive(tx_trigger_sem);  //trigger data upload
-
-            printf("new message - temp: %.1f C, light: %u lux, hum: %u%%, moist: %u, water: %s\n", 
-                temp_sensor_data.temperature, 
-                temp_sensor_data.light_level,
-                temp_sensor_data.humidity,
-                temp_sensor_data.moisture,
-                temp_sensor_data.water_level ? "HIGH" : "LOW");
-
-            //if (current_time - last_adafruit_post >= ADA_TIME_LIMIT) {  //adafruit limiter
-            //    publish_all_sensors(&current_sensor_data);
-            //    last_adafruit_post = current_time;
-            //}
+            if (rx_data.node == CAN_PRIMARY_NODE) {
+                power_sample_tick();
+            }
+
+            printf("new message from node %u - temp: %.1f C, light: %u lux, hum: %u%%, moist: %u, water: %s\n", 
+                rx_data.node,
+                rx_data.temperature, 
+                rx_data.light_level,
+                rx_data.humidity,
+                rx_data.moisture,
+                rx_data.water_level ? "HIGH" : "LOW");
+            if (rx_data.fields & (CAN_FIELD_EC | CAN_FIELD_PH | CAN_FIELD_CO2)) {
+                printf("    ec: %u uS/cm, ph: %.2f, co2: %u ppm\n", rx_data.ec, rx_data.ph_centi / 100.0f, rx_data.co2);
+            }
             }
         }
+        if (sensor_mask == 0) events &= ~CTRL_EVT_SENSOR; //frames dropped by the limiter or from pods outside any zone don't drive control
 
-        process_sensor_data(&temp_sensor_data, &is_pump_active, &current_light_pwm, &local_thresholds, new_data_arrived); //logic processing
+        if (events & CTRL_EVT_WATER_LEVEL) { //float switch flipped, refresh the reading the pump logic uses
+            bool water_level = read_water_level_sensor();
+            power_arm_water_wakeup(water_level);
 
-        update_hardware_actuators(is_pump_active, current_light_pwm, new_data_arrived); //adjusts outputs
+            for (int z = 0; z < (int)ZONE_COUNT; z++) { //one reservoir feeds every zone, a dry one stops running pumps in the step
+                SensorData latest = shared_sensor_read(zone_config[z].node);
+                if (latest.raw_id != 0 && latest.water_level != water_level) {
+                    latest.water_level = water_level;
+                    shared_sensor_write(zone_config[z].node, &latest);
+                }
+            }
+        }
+        if (events == 0) continue;
 
-        vTaskDelay(pdMS_TO_TICKS(10));
-    }
-}
+        static SensorData zone_data[ZONE_COUNT];
+        static ThresholdData zone_thresholds[ZONE_COUNT];
+        bool water_now = shared_take_water_now(); //one press waters once, however long the cloud feed stays at 1
+        if (water_now) atomic_store(&trigger_water_reset, true);
 
-void process_sensor_data(SensorData *data, bool *pump_state, uint32_t *light_pwm, ThresholdData *thresh, bool new_data) { 
-    static int64_t pump_start_time = 0;
-    static int64_t cooldown_start_time = 0;
-    static bool is_cooldown = false;
-    
-    if (thresh->on_off_toggle == 0) {
-        *pump_state = false;
-        *light_pwm = 0;
-        return; 
-    }
+        for (int z = 0; z < (int)ZONE_COUNT; z++) { //lock-free, never waits on the network tasks
+            zone_data[z] = shared_sensor_read(zone_config[z].node);
+            zone_thresholds[z] = shared_thresholds_read(zone_config[z].node);
+            zone_thresholds[z].water_now = water_now ? 1 : 0; //the cloud button waters every zone, the pump budget staggers them
+        }
 
-    if (data->raw_id == 0) return; //ignore null data
+        process_sensor_data(zone_data, zone_thresholds, events, sensor_mask); //logic processing
 
-    int64_t current_time = esp_timer_get_time();
+        update_hardware_actuators(); //adjusts outputs
+        perf_record_latency(PERF_LAT_CONTROL, esp_timer_get_time() - wake_time);
+    }
+}
 
-    if (new_data == true) {
-        time_t now;
-        struct tm timeinfo;
-        time(&now);
-        localtime_r(&now, &timeinfo);
+static void control_timer_cb(void *arg) { //runs in the esp_timer task
+    control_post((uint32_t)(uintptr_t)arg);
+}
 
-        float current_hour_float = timeinfo.tm_hour + (timeinfo.tm_min / 60.0f);
-        float start_hour = 8.0f; // 8:00am start time
-        float end_hour = start_hour + thresh->light_hours;
+void control_post(uint32_t events) {
+    atomic_fetch_or(&control_pending, events); //never lost, even if the wakeup below can't be queued
+    ControlEvent wake = { .events = 0 };
+    xQueueSendToFront(control_queue, &wake, 0); //a full queue means the loop is about to wake up anyway
+}
 
-        //ensure time has synced through Wi-Fi (year > 1970) and time is within window
-        if (timeinfo.tm_year > (2024 - 1900) && current_hour_float >= start_hour && current_hour_float < end_hour) {
-            
-            int target_lux = get_target_lux(thresh->light_intensity);  //daytime logic
-            int error = target_lux - data->light_level;
-            int pwm_jump = error * PWM_LUX_RATIO;
-            
-            int new_pwm = (int)*light_pwm + pwm_jump;
+void control_post_from_isr(uint32_t events) {
+    atomic_fetch_or(&control_pending, events);
+    ControlEvent wake = { .events = 0 };
+    BaseType_t woken = pdFALSE;
+    xQueueSendToFrontFromISR(control_queue, &wake, &woken);
+    if (woken) portYIELD_FROM_ISR();
+}
 
-            if (new_pwm > 255) new_pwm = 255;  
-            if (new_pwm < 0) new_pwm = 0;
+static void on_local_thresholds(const ThresholdData *thresh, uint8_t feeds) { //httpd task, a LAN write goes the same way as a cloud update
+    if (thresh->water_now == 1) shared_request_water_now();
+    shared_thresholds_write(-1, thresh);
+    control_post(CTRL_EVT_THRESHOLDS);
+    warm_boot_save_thresholds(thresh);
+
+    feeds &= ~(1u << THRESH_WATER_NOW); //a press is local only, on the cloud feed it would water a second time
+    if (ADA_CLOUD_ENABLE && feeds != 0) { //the cloud group would revert the write on the next pull, so it is written there too
+        atomic_fetch_or(&lan_feeds_held, feeds);
+        atomic_fetch_or(&lan_feeds_unpushed, feeds);
+        UploadSample wake = { .feeds = 0 }; //carries nothing, only wakes adafruit_tx_task for the push
+        xQueueSend(upload_queue, &wake, 0);
+    }
+}
 
-            *light_pwm = (uint32_t)new_pwm;
+static void hold_lan_thresholds(ThresholdData *pulled) { //rx task, fields written over the LAN win until the cloud caught up
+    uint32_t held = atomic_load(&lan_feeds_held);
+    if (held == 0) return;
+
+    ThresholdData local = shared_thresholds_read(CAN_PRIMARY_NODE);
+    for (int feed = 0; feed < THRESHOLD_FEED_COUNT; feed++) {
+        if (!(held & (1u << feed))) continue;
+        char cloud_value[THRESHOLD_VALUE_MAX + 1], local_value[THRESHOLD_VALUE_MAX + 1];
+        threshold_format_value(pulled, feed, cloud_value, sizeof(cloud_value));
+        threshold_format_value(&local, feed, local_value, sizeof(local_value));
+        if (strcmp(cloud_value, local_value) == 0) { //pushed and read back, from here on the cloud value counts again
+            atomic_fetch_and(&lan_feeds_held, ~(1u << feed));
+            atomic_fetch_and(&lan_feeds_unpushed, ~(1u << feed));
         } else {
-            *light_pwm = 0; //nighttime
+            threshold_copy_value(pulled, &local, feed);
         }
     }
+}
 
-    if (thresh->water_now == 1) {  //manual override
-        if (data->water_level == true) {
-            *pump_state = true;
-            pump_start_time = current_time;
-        }
-        thresh->water_now = 0;  //reset
-        trigger_water_reset = true;  //reset
-    } 
-    else if (*pump_state == false && is_cooldown == false && new_data == true) { //standard operation
-        if ((data->moisture < thresh->moisture) && (data->water_level == true)) {
-            *pump_state = true;
-            pump_start_time = current_time;
+static void push_lan_thresholds(void) { //tx task, publish_feed is only safe from here
+    uint32_t unpushed = atomic_load(&lan_feeds_unpushed);
+    ThresholdData local = shared_thresholds_read(CAN_PRIMARY_NODE);
+
+    for (int feed = 0; feed < THRESHOLD_FEED_COUNT; feed++) {
+        if (!(unpushed & (1u << feed))) continue;
+        char key[96], value[THRESHOLD_VALUE_MAX + 1];
+        snprintf(key, sizeof(key), "%s.%s", GROUP_THRESHOLDS, threshold_feed_keys[feed]);
+        threshold_format_value(&local, feed, value, sizeof(value));
+        if (ada_transport->publish_feed(key, value)) {
+            atomic_fetch_and(&lan_feeds_unpushed, ~(1u << feed)); //still held until a pull shows it
+            printf(" pushed local %s = %s to adafruit\n", threshold_feed_keys[feed], value);
         }
     }
+}
 
-    if (*pump_state == true) {
-        if (current_time - pump_start_time >= 5000000ULL) { //run for 5 seconds
-            *pump_state = false;
-            is_cooldown = true;
-            cooldown_start_time = current_time;
-        }
+static void on_water_level_change(void) { //gpio ISR
+    if (!read_water_level_sensor()) pump_driver_cut_all_from_isr(); //don't wait for the control loop to stop a dry pump
+    control_post_from_isr(CTRL_EVT_WATER_LEVEL);
+}
+
+void control_timers_init(void) {
+    esp_timer_create_args_t args = {
+        .callback = control_timer_cb,
+        .arg = (void *)(uintptr_t)CTRL_EVT_TIMER,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "control",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&args, &control_timer));
+}
+
+void process_sensor_data(SensorData *data, ThresholdData *thresh, uint32_t events, uint32_t sensor_mask) {
+    time_t now;
+    struct tm timeinfo;
+    time(&now);
+    localtime_r(&now, &timeinfo);
+
+    PlantActions actions;
+    for (int z = 0; z < (int)ZONE_COUNT; z++) plant_control.pump_run_us[z] = pump_dose_run_us(z); //picks up a recalibration on the next run
+    for (int i = 0; i < LUX_LEVELS; i++) plant_control.lux_target[i] = tunable_get(TUNE_LUX_LOW + i); //and console tuning on the next step
+    plant_control.pump_cooldown_us = tunable_get(TUNE_PUMP_COOLDOWN_S) * 1000000LL;
+    int64_t now_us = esp_timer_get_time();
+    plant_control_step(&plant_control, data, thresh, events, sensor_mask, now_us, &timeinfo, &actions); //decisions only, the timer is run here
+
+    esp_timer_stop(control_timer); //fails harmlessly if it wasn't running
+    if (actions.next_deadline_us != 0) {
+        int64_t timeout_us = actions.next_deadline_us - esp_timer_get_time();
+        esp_timer_start_once(control_timer, (timeout_us > 0) ? timeout_us : 0);
     }
 
-    if (is_cooldown == true) {
-        if (current_time - cooldown_start_time >= PUMP_COOLDOWN) { //1 min pump cooldown
-            is_cooldown = false;
-        }
+    for (int z = 0; z < (int)ZONE_COUNT; z++) {
+        if (!(actions.lut_done & (1u << z))) continue;
+        esp_err_t err = light_lut_save(z, &plant_control.lut[z]);
+        printf(" zone %d: light calibration done, full output %u lux%s\n", z, plant_control.lut[z].lux[LIGHT_LUT_POINTS - 1], (err == ESP_OK) ? "" : " (not saved)");
     }
 }
 
-void update_hardware_actuators(bool pump_state, uint32_t light_pwm, bool new_data) {  
-    static bool last_pump_state = false;//trigger only when changing them
-    static uint32_t last_light_pwm = 300; //illegal value to cover startup edge cases
-    
-    if (pump_state != last_pump_state) {
-        gpio_set_level(PUMP_PIN, pump_state ? 1 : 0);
-        printf(" ACTION: water pump turned %s\n", pump_state ? "ON" : "OFF");
-        last_pump_state = pump_state;
+void update_hardware_actuators(void) {  
+    for (int z = 0; z < (int)ZONE_COUNT; z++) { //trigger only when changing them
+        bool pump_state = plant_control.pump_on[z];
+        if (pump_state != zone_pump_output[z]) {
+            if (pump_state) {
+                if (pump_driver_start(z, plant_control.pump_run_us[z])) printf(" ACTION: zone %d water pump turned ON for %u ms\n", z, (unsigned)(plant_control.pump_run_us[z] / 1000));
+                else printf(" ACTION: zone %d water pump held off, reservoir empty or update running\n", z);
+            } else {
+                pump_driver_stop(z); //usually the timer has already cut it, this releases the timer
+                printf(" ACTION: zone %d water pump turned OFF\n", z);
+            }
+            zone_pump_output[z] = pump_state;
+        }
     }
 
     //if (light_state != last_light_state) {
@@ -232,46 +373,13 @@ void update_hardware_actuators(bool pump_state, uint32_t light_pwm, bool new_dat
     //    printf(" ACTION: led grow lights turned %s\n", light_state ? "ON" : "OFF");
     //    last_light_state = light_state;
     //}
-    //if(new_data) {
-        if (light_pwm != last_light_pwm) {
-            if (light_pwm == 0) {
-                ledc_stop(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0, 0); 
-                //gpio_set_level(LIGHT_PIN, 0);
-            } else {
-                int safe_last_pwm = (last_light_pwm == 300) ? 0 : last_light_pwm; //size of jump
-                int pwm_diff = abs((int)light_pwm - safe_last_pwm);
-                
-                int fade_time = (pwm_diff * 3000) / 255; //scale the time of the jump
-
-                if (fade_time < 50) { //if jump too small, set instantly
-                    ledc_set_duty(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0, light_pwm);
-                    ledc_update_duty(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0);
-                } else {
-                    ledc_set_fade_with_time(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0, light_pwm, fade_time);
-                    ledc_fade_start(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0, LEDC_FADE_NO_WAIT); 
-                }
-            }
-
-            //else {
-            //uint32_t target_duty = light_state ? 255 : 0; //sets target brightness (0-255)
-            //int fade_time = 3000;  //in ms
-            //ledc_set_fade_with_time(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0, light_pwm, fade_time);
-            //ledc_fade_start(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0, LEDC_FADE_NO_WAIT); //no wait mode
-            //}
-
-
-            printf("led grow lights adjusted to PWM: %lu/255\n", light_pwm);
-            last_light_pwm = light_pwm;
-        }
-    //}
+    for (int z = 0; z < (int)ZONE_COUNT; z++) {
+        light_output_set(zone_config[z].light, plant_control.light_level[z]); //no-op unless the level changed, gamma and channel mix happen in there
+    }
 }
 
 void hardware_init(void) { //GPIO initializations 
 
-    gpio_reset_pin(PUMP_PIN); 
-    gpio_set_direction(PUMP_PIN, GPIO_MODE_OUTPUT);
-    gpio_set_level(PUMP_PIN, 0); //force voltage low
-
     gpio_reset_pin(WATER_LEVEL_PIN); 
     gpio_set_direction(WATER_LEVEL_PIN, GPIO_MODE_INPUT);
     gpio_set_pull_mode(WATER_LEVEL_PIN, GPIO_FLOATING);
@@ -281,144 +389,124 @@ void hardware_init(void) { //GPIO initializations
     //gpio_set_level(LIGHT_PIN, 0); //force voltage low
     
     
-    ledc_timer_config_t ledc_timer = {  //configurations for LEDC Timer for PWM
-        .speed_mode       = LEDC_LOW_SPEED_MODE,
-        .timer_num        = LEDC_TIMER_0,
-        .duty_resolution  = LEDC_TIMER_8_BIT, //8bit resolution (0 to 255)
-        .freq_hz          = 5000, //5kHz PWM frequency
-        .clk_cfg          = LEDC_AUTO_CLK
-    };
-    ledc_timer_config(&ledc_timer);
-
-    
-    ledc_channel_config_t ledc_channel = {  //configurations for LEDC Channel for LIGHT_PIN
-        .speed_mode     = LEDC_LOW_SPEED_MODE,
-        .channel        = LEDC_CHANNEL_0,
-        .timer_sel      = LEDC_TIMER_0,
-        .intr_type      = LEDC_INTR_DISABLE,
-        .gpio_num       = LIGHT_PIN,
-        .duty           = 0, //start with 0% duty cycle (off)
-        .hpoint         = 0
-    };
-    ledc_channel_config(&ledc_channel);
-
-    ledc_fade_func_install(0);
+    light_output_init(); //LEDC timer and one channel per fixture spectrum
+    pump_driver_init(); //pump pins low, one hardware timer per zone ends each dose
 }
 
+#if CAN_BITRATE_KBPS == 1000
+#define CAN_TIMING_CONFIG() TWAI_TIMING_CONFIG_1MBITS()
+#elif CAN_BITRATE_KBPS == 800
+#define CAN_TIMING_CONFIG() TWAI_TIMING_CONFIG_800KBITS()
+#elif CAN_BITRATE_KBPS == 500
+#define CAN_TIMING_CONFIG() TWAI_TIMING_CONFIG_500KBITS()
+#elif CAN_BITRATE_KBPS == 250
+#define CAN_TIMING_CONFIG() TWAI_TIMING_CONFIG_250KBITS()
+#elif CAN_BITRATE_KBPS == 125
+#define CAN_TIMING_CONFIG() TWAI_TIMING_CONFIG_125KBITS()
+#else
+#error "unsupported CAN_BITRATE_KBPS"
+#endif
+
+#define CAN_ALERTS (TWAI_ALERT_BUS_OFF | TWAI_ALERT_BUS_RECOVERED | TWAI_ALERT_ERR_PASS | TWAI_ALERT_ERR_ACTIVE | \
+                    TWAI_ALERT_ABOVE_ERR_WARN | TWAI_ALERT_RX_QUEUE_FULL | TWAI_ALERT_RX_FIFO_OVERRUN)
+
 void can_driver_init(void) {  
     twai_general_config_t g_config = TWAI_GENERAL_CONFIG_DEFAULT(CAN_TX_PIN, CAN_RX_PIN, TWAI_MODE_NORMAL); 
-    twai_timing_config_t t_config = TWAI_TIMING_CONFIG_500KBITS(); 
-    twai_filter_config_t f_config = TWAI_FILTER_CONFIG_ACCEPT_ALL(); 
+    g_config.rx_queue_len = CAN_RX_QUEUE_LEN;
+    g_config.alerts_enabled = CAN_ALERTS; //polled by can_driver_check_health()
+    twai_timing_config_t t_config = CAN_TIMING_CONFIG(); 
+    twai_filter_config_t f_config = can_nodes_filter_config(); //hardware drops traffic from unregistered IDs
     
     ESP_ERROR_CHECK(twai_driver_install(&g_config, &t_config, &f_config));
     ESP_ERROR_CHECK(twai_start());
-    ESP_LOGI(TAG, "Driver started");
+    ESP_LOGI(TAG, "Driver started at %d kbit/s", CAN_BITRATE_KBPS);
 }
 
-bool can_driver_read_sensor(SensorData *out_data) {
-    twai_message_t rx_msg;
-    esp_err_t ret = twai_receive(&rx_msg, 0); 
+void can_driver_check_health(void) { //only called from can_rx_task, which also owns install/uninstall
+    static int64_t recovery_started = 0; //0 while the bus is up
 
-    if (ret == ESP_OK) { 
-        if (rx_msg.identifier == 0x101 && rx_msg.data_length_code >= 8) { 
-            
-            int16_t raw_temp = (rx_msg.data[0] << 8) | rx_msg.data[1];
-            out_data->temperature = raw_temp / 10.0f;
-            out_data->light_level = (rx_msg.data[2] << 8) | rx_msg.data[3];
-            out_data->humidity = (rx_msg.data[4] << 8) | rx_msg.data[5];
-            out_data->moisture = (rx_msg.data[6] << 8) | rx_msg.data[7];
-            out_data->raw_id = rx_msg.identifier;
-
-            return true;
+    uint32_t alerts = 0;
+    if (twai_read_alerts(&alerts, 0) != ESP_OK) alerts = 0;
+
+    if (alerts & TWAI_ALERT_ABOVE_ERR_WARN) printf(" CAN UPDATE: error counters above the warning limit\n");
+    if (alerts & TWAI_ALERT_ERR_PASS) printf(" CAN UPDATE: controller is error passive\n");
+    if (alerts & TWAI_ALERT_ERR_ACTIVE) printf(" CAN UPDATE: controller is error active again\n");
+    if (alerts & (TWAI_ALERT_RX_QUEUE_FULL | TWAI_ALERT_RX_FIFO_OVERRUN)) {
+        perf_count(PERF_CAN_RX_OVERFLOW, 1); //frames were lost before can_rx_task got to them
+    }
+
+    if (alerts & TWAI_ALERT_BUS_OFF) { //stops receiving until recovered, without this the bus stays silent forever
+        perf_count(PERF_CAN_BUS_OFF, 1);
+        printf(" CAN UPDATE: bus off, starting recovery\n");
+        twai_initiate_recovery(); //waits for 128 bus-free sequences
+        recovery_started = esp_timer_get_time();
+    }
+
+    if (alerts & TWAI_ALERT_BUS_RECOVERED) {
+        recovery_started = 0;
+        if (twai_start() == ESP_OK) printf(" CAN UPDATE: bus recovered\n"); //recovery leaves the driver stopped
+    } else if (recovery_started != 0 && esp_timer_get_time() - recovery_started >= CAN_RECOVERY_RETRY_MS * 1000LL) {
+        twai_status_info_t status;
+        recovery_started = 0;
+        if (twai_get_status_info(&status) != ESP_OK) return; //driver was reinstalled meanwhile, nothing to recover
+
+        if (status.state == TWAI_STATE_STOPPED) { //recovered but the alert was missed
+            twai_start();
+        } else if (status.state == TWAI_STATE_BUS_OFF) { //recovery never started, try again
+            twai_initiate_recovery();
+            recovery_started = esp_timer_get_time();
+        } else if (status.state == TWAI_STATE_RECOVERING) {
+            recovery_started = esp_timer_get_time(); //bus is still too busy to count the free sequences
         }
     }
-    return false; 
 }
 
-static void wifi_event_handler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data) {
-    if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
-        esp_wifi_connect(); // Try to connect when Wi-Fi driver starts
-    } 
-    else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
-        printf(" WIFI UPDATE: wifi connection lost or failed. attempting to reconnect\n");
-        esp_wifi_connect(); // Infinite retry loop in the background
-    } 
-    else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
-        printf(" WIFI UPDATE: wifi connected\n");
+void can_driver_request_resend(void) { //every registered pod repeats its newest message, see can_frame.h
+    twai_message_t msg = { .identifier = CAN_RESEND_REQUEST_ID, .data_length_code = 2 };
+    can_resend_request_encode((uint16_t)((1u << CAN_NODE_COUNT) - 1), msg.data);
+    if (twai_transmit(&msg, pdMS_TO_TICKS(CAN_HEALTH_POLL_MS)) != ESP_OK) printf(" CAN UPDATE: resend request not sent\n");
+}
+
+void can_driver_deinit(void) { //the driver holds a pm lock while installed, so it has to go for light sleep
+    twai_stop();
+    twai_driver_uninstall();
+}
+
+bool can_driver_read_sensor(SensorData *out_data, TickType_t timeout) { //only called from can_rx_task
+    static CanDecoder decoder; //multi-frame reassembly and sequence tracking per node
+    static bool decoder_ready = false;
+    if (!decoder_ready) {
+        can_decoder_init(&decoder);
+        decoder_ready = true;
     }
+
+    twai_message_t rx_msg;
+    esp_err_t ret = twai_receive(&rx_msg, timeout); 
+
+    if (ret == ESP_OK) { 
+        uint32_t lost_before = decoder.lost_total;
+        CanDecodeResult result = can_decoder_feed(&decoder, rx_msg.identifier, rx_msg.extd, rx_msg.data_length_code, rx_msg.data, out_data);
+        if (decoder.lost_total != lost_before) {
+            perf_count(PERF_CAN_LOST, decoder.lost_total - lost_before);
+            printf(" lost %u CAN messages from node %u\n", (unsigned)(decoder.lost_total - lost_before), out_data->node);
+        }
+        if (result == CAN_DECODE_SAMPLE) return true;
+        if (result == CAN_DECODE_REJECTED) perf_count(PERF_CAN_FILTERED, 1);
+    }
+    return false; 
 }
 
-void wifi_init(void) {  
+void nvs_init(void) {
     esp_err_t ret = nvs_flash_init();
     if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
         ESP_ERROR_CHECK(nvs_flash_erase());
         ret = nvs_flash_init();
     }
     ESP_ERROR_CHECK(ret);
-    
-    ESP_ERROR_CHECK(esp_netif_init());
-    ESP_ERROR_CHECK(esp_event_loop_create_default());
-    esp_netif_create_default_wifi_sta();
-
-    wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
-    ESP_ERROR_CHECK(esp_wifi_init(&cfg));
-
- 
-    ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &wifi_event_handler, NULL, NULL));
-    ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &wifi_event_handler, NULL, NULL));
-
-    wifi_config_t wifi_config = {0};
-    strncpy((char*)wifi_config.sta.ssid, WIFI_SSID, sizeof(wifi_config.sta.ssid));
-    strncpy((char*)wifi_config.sta.password, WIFI_PASS, sizeof(wifi_config.sta.password));
-    
-    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
-    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
-    
-    printf("starting wifi driver\n");
-    ESP_ERROR_CHECK(esp_wifi_start());
-    ESP_ERROR_CHECK(esp_wifi_set_ps(WIFI_PS_NONE));
 }
 
-void publish_all_sensors(SensorData *data) { 
-    char url[256];
-    snprintf(url, sizeof(url), "https://io.adafruit.com/api/v2/%s/groups/%s/data", AIO_USERNAME, GROUP_KEY_DATA);
-    char post_data[512];
-    
-    snprintf(post_data, sizeof(post_data), 
-        "{\"feeds\": ["
-            "{\"key\": \"%s\", \"value\": \"%.2f\"}, "
-            "{\"key\": \"%s\", \"value\": \"%u\"}, "
-            "{\"key\": \"%s\", \"value\": \"%u\"}, "
-            "{\"key\": \"%s\", \"value\": \"%u\"}, "
-            "{\"key\": \"%s\", \"value\": \"%d\"}"
-        "]}", 
-        FEED_TEMPERATURE, data->temperature,
-        FEED_LIGHT, data->light_level,
-        FEED_HUMIDITY, data->humidity,
-        FEED_MOISTURE, data->moisture,
-        FEED_WATER_LEVEL, data->water_level ? 1 : 0
-    );
-
-    esp_http_client_config_t config = {
-        .url = url,
-        .method = HTTP_METHOD_POST,
-        .crt_bundle_attach = esp_crt_bundle_attach, 
-    };
-    
-    esp_http_client_handle_t client = esp_http_client_init(&config);
-    esp_http_client_set_header(client, "X-AIO-Key", AIO_KEY);
-    esp_http_client_set_header(client, "Content-Type", "application/json");
-    esp_http_client_set_post_field(client, post_data, strlen(post_data));
-
-    esp_err_t err = esp_http_client_perform(client);
-    if (err == ESP_OK) {
-        printf(" SUCCESSFULLY uploaded all data to adafruit\n");
-    } else {
-        printf(" FAILED to upload data to adafruit\n");
-    }
-    
-    esp_http_client_close(client);
-    esp_http_client_cleanup(client);
+void wifi_init(void) {  
+    wifi_link_init(); //joins the cached AP first, see wifi_link.c
 }
 
 bool read_water_level_sensor(void) {
@@ -426,168 +514,222 @@ bool read_water_level_sensor(void) {
     return gpio_get_level(WATER_LEVEL_PIN) == 1;  //returns 1 if water is detected, 0 if empty
 }
 
-void pull_adafruit_thresholds(ThresholdData *thresh) {
-    //static int64_t last_pull_time = 0;
-    //int64_t current_time = esp_timer_get_time();
-
-    //if (last_pull_time != 0 && (current_time - last_pull_time < 20000000ULL)) { //if 20 seconds have not passed, exit
-    //    return; 
-    //}
-
-    char url[256]; //pulls data from adafruit
-    snprintf(url, sizeof(url), "https://io.adafruit.com/api/v2/%s/groups/%s", AIO_USERNAME, GROUP_THRESHOLDS);
+void rtos_tasks_init(void) {
+    control_queue = xQueueCreate(CONTROL_QUEUE_LEN, sizeof(ControlEvent));
+    upload_queue = xQueueCreate(ADA_UPLOAD_QUEUE_LEN, sizeof(UploadSample));
+    ada_transport = ada_transport_get();
+    if (ADA_CLOUD_ENABLE && !ada_transport->start()) {
+        printf("error: failed to start the %s adafruit transport\n", ada_transport->name);
+    }
+    if (OTA_ENABLE) ota_update_init();
+}
 
-    esp_http_client_config_t config = {
-        .url = url,
-        .method = HTTP_METHOD_GET,
-        .crt_bundle_attach = esp_crt_bundle_attach,
-    };
+#if CONFIG_FREERTOS_UNICORE
+#define CORE_CONTROL 0 //one core: the pins collapse and the priorities alone keep control ahead of the network
+#define CORE_NET 0
+#else
+#define CORE_CONTROL 1 //app core, nothing from the wifi/TLS path is pinned here
+#define CORE_NET 0 //same core as the wifi driver task (CONFIG_ESP_WIFI_TASK_PINNED_TO_CORE_0)
+#endif
 
-    esp_http_client_handle_t client = esp_http_client_init(&config);
-    esp_http_client_set_header(client, "X-AIO-Key", AIO_KEY);
-
-    esp_err_t err = esp_http_client_open(client, 0);
-    if (err == ESP_OK) {
-        esp_http_client_fetch_headers(client);
-        
-        //char buffer[2048] = {0}; 
-        char *buffer = calloc(1, 2048); 
-        if (buffer == NULL) {
-            printf(" failed to allocate memory for buffer\n");
-            esp_http_client_cleanup(client);
-            return;
+typedef struct {
+    TaskFunction_t fn;
+    const char *name;
+    uint32_t stack; //bytes
+    UBaseType_t priority;
+    BaseType_t core;
+} TaskSpec;
+
+static const TaskSpec task_table[] = { //sizes and priorities are TASK_* in constants.h
+    { control_task, "control", TASK_CONTROL_STACK, TASK_CONTROL_PRIO, CORE_CONTROL },
+    { can_rx_task, "can_rx", TASK_CAN_RX_STACK, TASK_CAN_RX_PRIO, CORE_CONTROL },
+#if ADA_CLOUD_ENABLE
+    { adafruit_rx_task, "adafruit_rx", TASK_ADA_RX_STACK, TASK_NET_PRIO, CORE_NET },
+    { adafruit_tx_task, "adafruit_tx", TASK_ADA_TX_STACK, TASK_NET_PRIO, CORE_NET },
+#endif
+    { ota_task, "ota", TASK_OTA_STACK, TASK_NET_PRIO, CORE_NET }, //always, a trial image has to confirm itself even with updates off
+};
+
+void rtos_tasks_start(void) {
+    if (control_queue == NULL || upload_queue == NULL) { //checks, then launches tasks
+        printf("erorr: failed to create RTOS queues\n");
+        return;
+    }
+    for (size_t i = 0; i < sizeof(task_table) / sizeof(task_table[0]); i++) {
+        const TaskSpec *spec = &task_table[i];
+        TaskHandle_t handle;
+        if (xTaskCreatePinnedToCore(spec->fn, spec->name, spec->stack, NULL, spec->priority, &handle, spec->core) != pdPASS) {
+            printf("error: failed to start task %s\n", spec->name);
+            continue;
         }
+        perf_register_task(handle); //stack high-water marks show up in the stats report
+    }
+}
 
-        int read_len = esp_http_client_read(client, buffer, 2048 - 1);
-        
-        if (read_len > 0) {
-            char *ptr = strstr(buffer, "\"light-intensity\"");
-            if (ptr && (ptr = strstr(ptr, "\"last_value\":\""))) {
-                thresh->light_intensity = atoi(ptr + 14);
-            }
-            
-            ptr = strstr(buffer, "\"moisture\"");
-            if (ptr && (ptr = strstr(ptr, "\"last_value\":\""))) {
-                thresh->moisture = atoi(ptr + 14);
-            }
+void can_rx_task(void *pvParameters) {
+    ControlEvent evt = { .events = CTRL_EVT_SENSOR };
 
-            ptr = strstr(buffer, "\"temperature\"");
-            if (ptr && (ptr = strstr(ptr, "\"last_value\":\""))) {
-                thresh->temperature = atoi(ptr + 14);
-            }
+    TickType_t timeout = pdMS_TO_TICKS(power_low_power_enabled() ? POWER_CAN_IDLE_MS : CAN_HEALTH_POLL_MS); //wakes up to check bus health
+    int64_t last_frame = esp_timer_get_time();
 
-            ptr = strstr(buffer, "\"on-off-toggle\"");
-            if (ptr && (ptr = strstr(ptr, "\"last_value\":\""))) {
-                char *val_ptr = ptr + 14; 
-                if (strncmp(val_ptr, "ON", 2) == 0 || strncmp(val_ptr, "1", 1) == 0) {
-                    thresh->on_off_toggle = 1; //on
-                } else {
-                    thresh->on_off_toggle = 0; //off
-                }
+    while (1) {
+        if (can_driver_read_sensor(&evt.data, timeout)) { //sleeps in the driver until a frame arrives
+            last_frame = esp_timer_get_time();
+            if (xQueueSend(control_queue, &evt, 0) != pdTRUE) {
+                perf_count(PERF_CAN_DROPPED, 1);
+                printf(" sensor queue full, dropped CAN frame\n");
+            } else {
+                perf_count(PERF_CAN_RX, 1);
             }
+        } else if (power_low_power_enabled() && esp_timer_get_time() - last_frame >= POWER_CAN_IDLE_MS * 1000LL) {
+            can_driver_deinit(); //bus went quiet, let the chip sleep until the next frame starts
+            power_wait_can_activity();
+            can_driver_init();
+            can_driver_request_resend(); //the frame that woke us went to the GPIO, not to TWAI
+            last_frame = esp_timer_get_time();
+        }
+        can_driver_check_health();
+    }
+}
 
-            ptr = strstr(buffer, "\"light-hours\"");
-            if (ptr && (ptr = strstr(ptr, "\"last_value\":\""))) {
-                thresh->light_hours = atof(ptr + 14);
-            }
+void adafruit_rx_task(void *pvParameters) {
+    int cloud_water_now = 0; //last water-now value seen on the feed, a press is its 0 -> 1 edge
+
+    while (1) {
+        if (!wifi_link_wait_up(pdMS_TO_TICKS(ADA_THRESH_POLL_MS))) continue; //no requests into a dead link, the defaults stay in place
+        ThresholdData local_thresh = shared_thresholds_read(CAN_PRIMARY_NODE); //pull current thresholds
 
-            ptr = strstr(buffer, "\"water-now\"");
-            if (ptr && (ptr = strstr(ptr, "\"last_value\":\""))) {
-                thresh->water_now = atoi(ptr + 14);
+        if (ada_transport->pull_thresholds(&local_thresh, pdMS_TO_TICKS(ADA_THRESH_POLL_MS)) == PULL_UPDATED) { //waits for the next poll or pushed update
+            hold_lan_thresholds(&local_thresh);
+            if (local_thresh.water_now == 1 && cloud_water_now == 0) {
+                shared_request_water_now();
             }
+            cloud_water_now = local_thresh.water_now;
 
-            printf(" downloaded thresholds light: %d moist: %d temp: %d toggle: %d light hours: %.1f water now: %d\n", 
-                   thresh->light_intensity, thresh->moisture, thresh->temperature, thresh->on_off_toggle, thresh->light_hours, thresh->water_now);
+            shared_thresholds_write(-1, &local_thresh); //update thresholds, the cloud group applies to every node
+            control_post(CTRL_EVT_THRESHOLDS);
+            warm_boot_save_thresholds(&local_thresh); //flash is only written when a value actually changed
         }
-
-        free(buffer);
-        esp_http_client_close(client);
-
-    } else {
-        printf(" failed to connect to Adafruit for threshold download\n");
     }
-    
-    esp_http_client_cleanup(client);
-    
-    //last_pull_time = esp_timer_get_time(); //timer reset
 }
 
-int get_target_lux(int level) {
-    if (level == 1) return LUX_TARGET_LOW;
-    if (level == 2) return LUX_TARGET_MEDIUM;
-    if (level == 3) return LUX_TARGET_HIGH;
-    return 0; //turns light off if illegal value
-}
+static bool date_samples(UploadSample *samples, size_t count) { //false while the clock is unset, unstamped samples stay that way
+    time_t now;
+    time(&now);
+    if (now <= CLOCK_VALID_AFTER) return false;
 
-void rtos_tasks_init(ThresholdData *thresh_data, SensorData *sensor_data) {
-    threshold_mutex = xSemaphoreCreateMutex(); //creates mutex
-    sensor_data_mutex = xSemaphoreCreateMutex();
-    tx_trigger_sem = xSemaphoreCreateBinary();
-    if (threshold_mutex != NULL && sensor_data_mutex != NULL && tx_trigger_sem != NULL) { //checks, then launches tasks
-        xTaskCreate(adafruit_rx_task, "adafruit_rx", 8192, thresh_data, 2, NULL);
-        xTaskCreate(adafruit_tx_task, "adafruit_tx", 8192, sensor_data, 2, NULL);
-        //printf("RTOS tasks and mutexes initialized successfully\n");
-    } else {
-        printf("erorr: failed to create RTOS mutexes\n");
+    int64_t uptime_us = esp_timer_get_time();
+    for (size_t i = 0; i < count; i++) {
+        if (samples[i].created_at == 0) samples[i].created_at = (int64_t)now - (uptime_us - samples[i].taken_us) / 1000000;
     }
+    return true;
 }
 
-ThresholdData get_safe_thresholds(ThresholdData *shared_thresh) {
-    ThresholdData safe_copy = {0};
-    
-    if (xSemaphoreTake(threshold_mutex, portMAX_DELAY)) { //lock, grab data, release lock
-        safe_copy = *shared_thresh;
-        xSemaphoreGive(threshold_mutex);
+static void store_offline(const UploadSample *samples, size_t count) { //only the feeds still set, a partly sent batch keeps the rest
+    size_t stored = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (samples[i].feeds == 0) continue;
+        if (!upload_log_append(&samples[i])) break;
+        stored++;
     }
-    
-    return safe_copy;
+    perf_count(PERF_UPLOAD_OFFLINE, stored);
+    printf(" stored %u samples in the offline log (%u waiting)\n", (unsigned)stored, (unsigned)upload_log_pending());
 }
 
-void adafruit_rx_task(void *pvParameters) {
-    ThresholdData *shared_thresh = (ThresholdData *)pvParameters;
-    ThresholdData local_thresh = {0};
+void adafruit_tx_task(void *pvParameters) {
+    static UploadSample batch[ADA_BATCH_MAX_SAMPLES];
+    static UploadSample backlog[ADA_BATCH_MAX_SAMPLES];
+    size_t batch_count = 0;
+    int64_t batch_started = 0;
+    int64_t last_drain = 0;
+    int64_t last_diag = esp_timer_get_time(); //first report after one interval, once there is something to show
 
-    vTaskDelay(pdMS_TO_TICKS(5000)); //delay for startup
+    upload_log_init(); //scans the log partition for samples left over from before a reboot
 
-    while (1) {
-        if (xSemaphoreTake(threshold_mutex, portMAX_DELAY)) { //pull current thresholds
-            local_thresh = *shared_thresh;
-            xSemaphoreGive(threshold_mutex);
-        }
+    wifi_link_wait_up(pdMS_TO_TICKS(WIFI_BOOT_WAIT_MS)); //give the first join a chance before samples go to the offline log
 
-        pull_adafruit_thresholds(&local_thresh); //download from adafruit servers
+    while (1) {
+        UploadSample sample;
+        TickType_t wait_ticks = portMAX_DELAY;
+        int64_t now = esp_timer_get_time();
 
-        if (xSemaphoreTake(threshold_mutex, portMAX_DELAY)) { //update thresholds
-            *shared_thresh = local_thresh;
-            xSemaphoreGive(threshold_mutex);
+        if (ADA_BATCH_MODE && batch_count > 0) { //wake up in time to flush the batch by age
+            int64_t remaining_us = batch_started + ADA_BATCH_MAX_AGE_US - now;
+            wait_ticks = (remaining_us > 0) ? (TickType_t)((remaining_us / 1000 + portTICK_PERIOD_MS) / portTICK_PERIOD_MS) : 0;
+        }
+        if (upload_log_pending() > 0) { //also wake up for the next rate-limited backlog batch
+            int64_t remaining_us = last_drain + ADA_DRAIN_INTERVAL_US - now;
+            TickType_t drain_ticks = (remaining_us > 0) ? (TickType_t)((remaining_us / 1000 + portTICK_PERIOD_MS) / portTICK_PERIOD_MS) : 0;
+            if (drain_ticks < wait_ticks) wait_ticks = drain_ticks;
+        }
+        if (PERF_DIAG_FEED_ENABLE) { //and for the diagnostics report
+            int64_t remaining_us = last_diag + PERF_DIAG_INTERVAL_US - now;
+            TickType_t diag_ticks = (remaining_us > 0) ? (TickType_t)((remaining_us / 1000 + portTICK_PERIOD_MS) / portTICK_PERIOD_MS) : 0;
+            if (diag_ticks < wait_ticks) wait_ticks = diag_ticks;
         }
 
-        vTaskDelay(pdMS_TO_TICKS(20000)); //20 second wait
-    }
-}
+        if (atomic_load(&lan_feeds_unpushed) != 0 && wait_ticks > pdMS_TO_TICKS(ADA_THRESH_POLL_MS)) { //a failed push is retried
+            wait_ticks = pdMS_TO_TICKS(ADA_THRESH_POLL_MS);
+        }
 
-void adafruit_tx_task(void *pvParameters) {
-    SensorData *shared_data = (SensorData *)pvParameters;
-    SensorData local_data = {0};
+        if (xQueueReceive(upload_queue, &sample, wait_ticks) == pdTRUE && sample.feeds != 0) { //an empty one is a wakeup
+            if (!ADA_BATCH_MODE) {
+                date_samples(&sample, 1);
+                if (!wifi_link_is_up() || !ada_transport->publish_sample(&sample)) {
+                    store_offline(&sample, 1);
+                } else {
+                    perf_count(PERF_UPLOAD_OK, 1);
+                }
+            } else {
+                if (batch_count == 0) batch_started = esp_timer_get_time();
+                batch[batch_count++] = sample;
+            }
+        }
 
-    vTaskDelay(pdMS_TO_TICKS(3000)); //3 second wifi delay after boot
+        if (ADA_BATCH_MODE && batch_count > 0 &&
+            (batch_count >= ADA_BATCH_MAX_SAMPLES || esp_timer_get_time() - batch_started >= ADA_BATCH_MAX_AGE_US)) {
+            date_samples(batch, batch_count); //a live sample left unstamped is dated by adafruit on arrival, close enough
+            if (!wifi_link_is_up() || !ada_transport->publish_batch(batch, batch_count)) {
+                store_offline(batch, batch_count);
+            } else {
+                perf_count(PERF_UPLOAD_OK, batch_count);
+            }
+            batch_count = 0;
+        }
 
-    while (1) {
-        if (xSemaphoreTake(tx_trigger_sem, portMAX_DELAY)) {  //grab latest data
-            
-            if (xSemaphoreTake(sensor_data_mutex, portMAX_DELAY)) {
-                local_data = *shared_data;
-                xSemaphoreGive(sensor_data_mutex);
+        if (wifi_link_is_up() && upload_log_pending() > 0 && esp_timer_get_time() - last_drain >= ADA_DRAIN_INTERVAL_US) {
+            last_drain = esp_timer_get_time(); //rate limit the backlog whether or not this batch goes through
+            size_t count = upload_log_peek(backlog, ADA_BATCH_MAX_SAMPLES);
+            if (!date_samples(backlog, count)) count = 0; //replayed without created_at they would all land at the drain time
+            int points = 0;
+            size_t fit = 0;
+            portENTER_CRITICAL(&upload_budget_lock); //replayed points count against the same account limit as live ones
+            int budget = upload_filter_budget(&upload_filter, esp_timer_get_time());
+            while (fit < count && points + __builtin_popcount(backlog[fit].feeds) <= budget) points += __builtin_popcount(backlog[fit++].feeds);
+            upload_filter_charge(&upload_filter, points);
+            portEXIT_CRITICAL(&upload_budget_lock);
+            count = fit; //the rest waits for the budget to refill
+            if (count > 0) {
+                bool all_sent = ada_transport->publish_batch(backlog, count);
+                upload_log_ack(backlog, count); //whatever was delivered or refused for good leaves the log, even on a partial failure
+                if (all_sent) {
+                    perf_count(PERF_UPLOAD_OK, count);
+                    printf(" drained %u samples from the offline log (%u left)\n", (unsigned)count, (unsigned)upload_log_pending());
+                }
             }
+        }
 
-            publish_all_sensors(&local_data);
+        if (wifi_link_is_up() && atomic_load(&lan_feeds_unpushed) != 0) push_lan_thresholds();
 
-            if (trigger_water_reset) {
-                trigger_water_reset = false;
-                reset_water_now_feed();
-            }
+        if (wifi_link_is_up() && atomic_exchange(&trigger_water_reset, false) && !ada_transport->reset_water_now()) {
+            atomic_store(&trigger_water_reset, true); //try again on the next pass
+        }
 
-            vTaskDelay(pdMS_TO_TICKS(ADA_TIME_LIMIT / 1000)); 
+        if (PERF_DIAG_FEED_ENABLE && wifi_link_is_up() && esp_timer_get_time() - last_diag >= PERF_DIAG_INTERVAL_US) {
+            static char report[ADA_FEED_VALUE_MAX]; //kept off the task stack like the batch buffers
+            last_diag = esp_timer_get_time(); //a failed report is skipped, not retried
+            perf_format_compact(report, sizeof(report));
+            ada_transport->publish_feed(GROUP_KEY_DATA "." PERF_DIAG_FEED, report);
         }
     }
 }
@@ -602,29 +744,3 @@ void time_sync_init(void) {  //compares time against plant thresholds
     //printf("mountain time zone set\n");
 }
 
-void reset_water_now_feed(void) {
-    char url[256];
-    snprintf(url, sizeof(url), "https://io.adafruit.com/api/v2/%s/feeds/%s.water-now/data", AIO_USERNAME, GROUP_THRESHOLDS);
-    char post_data[64] = "{\"value\": \"0\"}";
-    
-    esp_http_client_config_t config = {
-        .url = url,
-        .method = HTTP_METHOD_POST,
-        .crt_bundle_attach = esp_crt_bundle_attach, 
-    };
-    
-    esp_http_client_handle_t client = esp_http_client_init(&config);
-    esp_http_client_set_header(client, "X-AIO-Key", AIO_KEY);
-    esp_http_client_set_header(client, "Content-Type", "application/json");
-    esp_http_client_set_post_field(client, post_data, strlen(post_data));
-
-    esp_err_t err = esp_http_client_perform(client);
-    if (err == ESP_OK) {
-        printf(" SUCCESSFULLY reset Adafruit water-now button to 0\n");
-    } else {
-        printf(" FAILED to reset Adafruit water-now button\n");
-    }
-    
-    esp_http_client_close(client);
-    esp_http_client_cleanup(client);
-}
\ No newline at end of file
@@ -0,0 +1,307 @@
+#include "ada_transport.h"
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "esp_http_client.h"
+#include "ada_tls.h"
+#include "esp_timer.h"
+#include "constants.h"
+#include "threshold_parser.h"
+#include "secrets.h"
+#include "perf_stats.h"
+
+//every URL and the fixed parts of each body are literals, only the values are formatted per upload
+#define SAMPLE_URL ADA_API_URL "/groups/" GROUP_KEY_DATA "/data"
+#define BATCH_URL(feed) ADA_API_URL "/feeds/" GROUP_KEY_DATA "." feed "/data/batch"
+#define THRESHOLDS_URL ADA_API_URL "/groups/" GROUP_THRESHOLDS
+#define WATER_NOW_URL ADA_API_URL "/feeds/" GROUP_THRESHOLDS ".water-now/data"
+
+#define SAMPLE_HEAD "{\"feeds\": ["
+#define SAMPLE_KEY(feed) "{\"key\": \"" feed "\", \"value\": \""
+#define SAMPLE_NEXT "\"}, "
+#define SAMPLE_TAIL "\"}]"
+#define CREATED_AT_HEAD ", \"created_at\": \""
+#define SAMPLE_FIXED_TEXT SAMPLE_HEAD SAMPLE_KEY(FEED_TEMPERATURE) SAMPLE_NEXT SAMPLE_KEY(FEED_LIGHT) SAMPLE_NEXT SAMPLE_KEY(FEED_HUMIDITY) \
+                          SAMPLE_NEXT SAMPLE_KEY(FEED_MOISTURE) SAMPLE_NEXT SAMPLE_KEY(FEED_WATER_LEVEL) SAMPLE_TAIL CREATED_AT_HEAD "\"}"
+#define SAMPLE_BODY_MAX (sizeof(SAMPLE_FIXED_TEXT) + UPLOAD_FEED_COUNT * ADA_SAMPLE_VALUE_MAX + ADA_CREATED_AT_LEN)
+
+#define BATCH_HEAD "{\"data\": ["
+#define BATCH_ITEM_MAX (sizeof(", {\"value\": \"\"" CREATED_AT_HEAD "\"}") - 1 + ADA_SAMPLE_VALUE_MAX + ADA_CREATED_AT_LEN)
+#define BATCH_BODY_MAX (sizeof(BATCH_HEAD "]}") + ADA_BATCH_MAX_SAMPLES * BATCH_ITEM_MAX)
+
+static const AdaFragment sample_fragments[UPLOAD_FEED_COUNT] = { //text before each value, same order as ada_upload_feed_keys
+    ADA_FRAGMENT(SAMPLE_KEY(FEED_TEMPERATURE)),
+    ADA_FRAGMENT(SAMPLE_KEY(FEED_LIGHT)),
+    ADA_FRAGMENT(SAMPLE_KEY(FEED_HUMIDITY)),
+    ADA_FRAGMENT(SAMPLE_KEY(FEED_MOISTURE)),
+    ADA_FRAGMENT(SAMPLE_KEY(FEED_WATER_LEVEL)),
+};
+
+static const char *const batch_urls[UPLOAD_FEED_COUNT] = {
+    BATCH_URL(FEED_TEMPERATURE), BATCH_URL(FEED_LIGHT), BATCH_URL(FEED_HUMIDITY), BATCH_URL(FEED_MOISTURE), BATCH_URL(FEED_WATER_LEVEL),
+};
+
+static SemaphoreHandle_t http_client_mutex;
+static esp_http_client_handle_t ada_client = NULL; //persistent keep-alive session to io.adafruit.com
+static char ada_response_etag[64]; //ETag of the last response on ada_client, written by its event handler
+static int64_t ada_request_start = 0; //set under the mutex, read by the event handler of the same request
+
+static esp_err_t ada_client_event_handler(esp_http_client_event_t *evt) {
+    if (evt->event_id == HTTP_EVENT_ON_CONNECTED) { //only fires when a new socket was opened, reused ones skip it
+        perf_record_latency(PERF_LAT_CONNECT, esp_timer_get_time() - ada_request_start);
+    }
+    if (evt->event_id == HTTP_EVENT_ON_HEADER && strcasecmp(evt->header_key, "ETag") == 0) {
+        strlcpy(ada_response_etag, evt->header_value, sizeof(ada_response_etag));
+    }
+    return ESP_OK;
+}
+
+static esp_http_client_handle_t adafruit_client_acquire(const char *url, esp_http_client_method_t method) {
+    int64_t wait_start = esp_timer_get_time();
+    if (xSemaphoreTake(http_client_mutex, portMAX_DELAY) != pdTRUE) { //rx and tx tasks share one session
+        return NULL;
+    }
+    ada_request_start = esp_timer_get_time();
+    perf_record_latency(PERF_LAT_HTTP_LOCK, ada_request_start - wait_start);
+
+    if (ada_client == NULL) { //first request creates the session, later ones only retarget it
+        esp_http_client_config_t config = {
+            .url = url,
+            .method = method,
+            .keep_alive_enable = true,
+            .event_handler = ada_client_event_handler,
+#if CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+            .save_client_session = true, //resume TLS with a session ticket after a reconnect
+#endif
+        };
+        ada_tls_apply_http(&config); //pinned CA or the bundle
+
+        ada_client = esp_http_client_init(&config);
+        if (ada_client == NULL) {
+            xSemaphoreGive(http_client_mutex);
+            return NULL;
+        }
+        esp_http_client_set_header(ada_client, "X-AIO-Key", AIO_KEY);
+    } else {
+        esp_http_client_set_url(ada_client, url); //same host, so the open connection is kept
+        esp_http_client_set_method(ada_client, method);
+    }
+
+    ada_response_etag[0] = '\0';
+    esp_http_client_delete_header(ada_client, "If-None-Match"); //only set for the request that asks for it
+
+    if (method == HTTP_METHOD_GET) { //clear leftovers from the previous POST
+        esp_http_client_delete_header(ada_client, "Content-Type");
+        esp_http_client_set_post_field(ada_client, NULL, 0);
+    }
+
+    return ada_client;
+}
+
+static void adafruit_client_release(bool keep_connection) {
+    if (!keep_connection) {
+        esp_http_client_close(ada_client); //drop the socket, next request reconnects
+    }
+    xSemaphoreGive(http_client_mutex);
+}
+
+static bool http_start(void) {
+    http_client_mutex = xSemaphoreCreateMutex(); //rx and tx tasks share one session
+    return http_client_mutex != NULL && ada_tls_init();
+}
+
+static int post_json_status(const char *url, const char *body, size_t len) { //HTTP status, 0 if no answer came back
+    int64_t start = esp_timer_get_time();
+    esp_http_client_handle_t client = adafruit_client_acquire(url, HTTP_METHOD_POST);
+    if (client == NULL) {
+        return 0;
+    }
+    esp_http_client_set_header(client, "Content-Type", "application/json");
+
+    esp_err_t err = esp_http_client_open(client, (int)len); //the body is written from the caller's buffer as is
+    if (err == ESP_OK && esp_http_client_write(client, body, (int)len) != (int)len) err = ESP_FAIL;
+    if (err == ESP_OK && esp_http_client_fetch_headers(client) < 0) err = ESP_FAIL;
+    int status = (err == ESP_OK) ? esp_http_client_get_status_code(client) : 0;
+    if (err == ESP_OK) esp_http_client_flush_response(client, NULL); //drain the reply so the connection can be reused
+
+    adafruit_client_release(err == ESP_OK); //keep the session open unless it failed
+    perf_record_latency(PERF_LAT_PUBLISH, esp_timer_get_time() - start);
+    return status;
+}
+
+static bool post_json(const char *url, const char *body, size_t len) {
+    int status = post_json_status(url, body, len);
+    return status >= 200 && status < 300;
+}
+
+static bool refused_for_good(int status) { //the request itself is wrong, resending it can't help. auth and throttling are about the account
+    return status >= 400 && status < 500 && status != 401 && status != 403 && status != 408 && status != 429;
+}
+
+static bool http_publish_sample(const UploadSample *sample) {
+    static char body[SAMPLE_BODY_MAX]; //only used by the tx task, kept off its stack
+    size_t len = ADA_PUT_LITERAL(body, SAMPLE_HEAD);
+    int sent = 0;
+
+    for (int feed = 0; feed < UPLOAD_FEED_COUNT; feed++) {
+        if (!(sample->feeds & (1u << feed))) continue; //unchanged since the last upload
+        if (sent++ > 0) len += ADA_PUT_LITERAL(body + len, SAMPLE_NEXT);
+        len += ADA_PUT_FRAGMENT(body + len, sample_fragments[feed]);
+        len += ada_put_feed_value(&sample->data, feed, body + len);
+    }
+    if (sent == 0) return true;
+    len += ADA_PUT_LITERAL(body + len, SAMPLE_TAIL);
+    if (sample->created_at != 0) {
+        len += ADA_PUT_LITERAL(body + len, CREATED_AT_HEAD);
+        len += ada_put_created_at(sample->created_at, body + len);
+        body[len++] = '"';
+    }
+    body[len++] = '}';
+
+    bool ok = post_json(SAMPLE_URL, body, len);
+    if (ok) {
+        printf(" SUCCESSFULLY uploaded %d feeds to adafruit\n", sent);
+    } else {
+        printf(" FAILED to upload data to adafruit\n");
+    }
+    return ok;
+}
+
+static bool http_publish_batch(UploadSample *samples, size_t count) {
+    static char body[BATCH_BODY_MAX]; //only used by the tx task, kept off its stack, sized for the worst case
+    bool all_ok = true;
+    if (count > ADA_BATCH_MAX_SAMPLES) return false;
+
+    for (int feed = 0; feed < UPLOAD_FEED_COUNT; feed++) { //one batch POST per feed covers every sample
+        size_t len = ADA_PUT_LITERAL(body, BATCH_HEAD);
+        size_t items = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (!(samples[i].feeds & (1u << feed))) continue;
+            if (items++ > 0) len += ADA_PUT_LITERAL(body + len, ", ");
+            len += ADA_PUT_LITERAL(body + len, "{\"value\": \"");
+            len += ada_put_feed_value(&samples[i].data, feed, body + len);
+            body[len++] = '"';
+            if (samples[i].created_at != 0) {
+                len += ADA_PUT_LITERAL(body + len, CREATED_AT_HEAD);
+                len += ada_put_created_at(samples[i].created_at, body + len);
+                body[len++] = '"';
+            }
+            body[len++] = '}';
+        }
+        len += ADA_PUT_LITERAL(body + len, "]}");
+        if (items == 0) continue; //nothing new for this feed in the whole batch, no request
+
+        int status = post_json_status(batch_urls[feed], body, len);
+        if (status >= 200 && status < 300) {
+            for (size_t i = 0; i < count; i++) samples[i].feeds &= ~(1u << feed); //delivered, a retry only resends the other feeds
+        } else if (refused_for_good(status)) {
+            printf(" adafruit refused the %s batch (%d), dropping it\n", ada_upload_feed_keys[feed], status);
+            for (size_t i = 0; i < count; i++) samples[i].feeds &= ~(1u << feed); //would block the log head forever
+            all_ok = false;
+        } else {
+            printf(" FAILED to upload %s batch to adafruit\n", ada_upload_feed_keys[feed]);
+            all_ok = false;
+        }
+    }
+
+    if (all_ok) {
+        printf(" SUCCESSFULLY uploaded %u samples to adafruit\n", (unsigned)count);
+    }
+    return all_ok;
+}
+
+static PullResult http_pull_thresholds(ThresholdData *thresh, TickType_t wait) {
+    static char thresholds_etag[64] = ""; //version of the group we last applied
+    static TickType_t last_poll = 0;
+    PullResult result = PULL_FAILED;
+
+    if (last_poll != 0) { //plain polling, the 304 keeps unchanged polls cheap
+        vTaskDelayUntil(&last_poll, wait);
+    } else {
+        last_poll = xTaskGetTickCount();
+    }
+
+    int64_t start = esp_timer_get_time(); //timed from here, the poll delay above is not latency
+    esp_http_client_handle_t client = adafruit_client_acquire(THRESHOLDS_URL, HTTP_METHOD_GET); //pulls data from adafruit
+    if (client == NULL) {
+        printf(" failed to connect to Adafruit for threshold download\n");
+        return PULL_FAILED;
+    }
+    if (thresholds_etag[0] != '\0') {
+        esp_http_client_set_header(client, "If-None-Match", thresholds_etag); //lets the server answer 304 when nothing changed
+    }
+
+    esp_err_t err = esp_http_client_open(client, 0);
+    if (err == ESP_OK && esp_http_client_fetch_headers(client) >= 0 && esp_http_client_get_status_code(client) == 304) {
+        esp_http_client_flush_response(client, NULL);
+        adafruit_client_release(true);
+        perf_record_latency(PERF_LAT_PULL, esp_timer_get_time() - start);
+        return PULL_UNCHANGED;
+    }
+
+    if (err == ESP_OK) {
+        ThresholdData parsed = *thresh; //parse into a copy so a broken response changes nothing
+        ThresholdParser parser;
+        threshold_parser_init(&parser, &parsed);
+
+        char chunk[256]; //the response is streamed through the parser, any length works
+        int read_len;
+        while ((read_len = esp_http_client_read(client, chunk, sizeof(chunk))) > 0) {
+            if (!threshold_parser_feed(&parser, chunk, read_len)) break;
+        }
+
+        int applied = threshold_parser_finish(&parser);
+        if (read_len >= 0 && applied > 0 && esp_http_client_get_status_code(client) == 200) {
+            *thresh = parsed;
+            strlcpy(thresholds_etag, ada_response_etag, sizeof(thresholds_etag)); //empty if the server sent none
+            result = PULL_UPDATED;
+            printf(" downloaded thresholds light: %d moist: %d temp: %d toggle: %d light hours: %.1f water now: %d\n", 
+                   thresh->light_intensity, thresh->moisture, thresh->temperature, thresh->on_off_toggle, thresh->light_hours, thresh->water_now);
+        } else {
+            printf(" failed to parse threshold download\n");
+        }
+
+        esp_http_client_flush_response(client, NULL); //drain anything left so the connection can be reused
+        adafruit_client_release(read_len >= 0);
+
+    } else {
+        printf(" failed to connect to Adafruit for threshold download\n");
+        adafruit_client_release(false);
+    }
+
+    perf_record_latency(PERF_LAT_PULL, esp_timer_get_time() - start);
+    return result;
+}
+
+static bool http_reset_water_now(void) {
+    static const char body[] = "{\"value\": \"0\"}";
+
+    bool ok = post_json(WATER_NOW_URL, body, sizeof(body) - 1);
+    if (ok) {
+        printf(" SUCCESSFULLY reset Adafruit water-now button to 0\n");
+    } else {
+        printf(" FAILED to reset Adafruit water-now button\n");
+    }
+    return ok;
+}
+
+static bool http_publish_feed(const char *feed_key, const char *value) {
+    char url[160];
+    snprintf(url, sizeof(url), ADA_API_URL "/feeds/%s/data", feed_key); //feed keys vary, this one is still formatted
+
+    static char body[ADA_FEED_VALUE_MAX + 16]; //only used by the tx task, kept off its stack
+    size_t len = snprintf(body, sizeof(body), "{\"value\": \"%s\"}", value); //value is plain text, never quoted or escaped
+    return len < sizeof(body) && post_json(url, body, len);
+}
+
+const AdaTransport ada_http_transport = {
+    .name = "http",
+    .start = http_start,
+    .publish_sample = http_publish_sample,
+    .publish_batch = http_publish_batch,
+    .pull_thresholds = http_pull_thresholds,
+    .reset_water_now = http_reset_water_now,
+    .publish_feed = http_publish_feed,
+};
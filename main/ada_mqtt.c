@@ -0,0 +1,314 @@
+#include "ada_transport.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "mqtt_client.h"
+#include "ada_tls.h"
+#include "esp_timer.h"
+#include "constants.h"
+#include "threshold_parser.h"
+#include "secrets.h"
+#include "perf_stats.h"
+
+//adafruit io over one persistent mqtts connection.
+//sensor samples go to the data group topic, the threshold feeds are subscribed to and
+//arrive as single values which are collected here until adafruit_rx_task pulls them.
+
+#define SAMPLE_TOPIC AIO_USERNAME "/groups/" GROUP_KEY_DATA
+#define FEED_JSON_TOPIC(feed) AIO_USERNAME "/feeds/" GROUP_KEY_DATA "." feed "/json" //the json feed topic is the one that takes created_at
+#define WATER_NOW_TOPIC AIO_USERNAME "/feeds/" GROUP_THRESHOLDS ".water-now"
+
+#define SAMPLE_HEAD "{\"feeds\": {"
+#define SAMPLE_KEY(feed) "\"" feed "\": \""
+#define SAMPLE_FIXED_TEXT SAMPLE_HEAD SAMPLE_KEY(FEED_TEMPERATURE) "\", " SAMPLE_KEY(FEED_LIGHT) "\", " SAMPLE_KEY(FEED_HUMIDITY) \
+                          "\", " SAMPLE_KEY(FEED_MOISTURE) "\", " SAMPLE_KEY(FEED_WATER_LEVEL) "\"}}"
+#define FEED_JSON_FIXED_TEXT "{\"value\": \"\", \"created_at\": \"\"}"
+#define GROUP_PAYLOAD_MAX (sizeof(SAMPLE_FIXED_TEXT) + UPLOAD_FEED_COUNT * ADA_SAMPLE_VALUE_MAX) //worst case, never truncates
+#define BATCH_PUBLISH_MAX (ADA_BATCH_MAX_SAMPLES * UPLOAD_FEED_COUNT) //one publish per feed of each sample at most
+#define ACKED_IDS_MAX (BATCH_PUBLISH_MAX + 8) //room for late PUBACKs of diagnostics or water-now publishes
+
+static const AdaFragment sample_keys[UPLOAD_FEED_COUNT] = { //text before each value, same order as ada_upload_feed_keys
+    ADA_FRAGMENT(SAMPLE_KEY(FEED_TEMPERATURE)),
+    ADA_FRAGMENT(SAMPLE_KEY(FEED_LIGHT)),
+    ADA_FRAGMENT(SAMPLE_KEY(FEED_HUMIDITY)),
+    ADA_FRAGMENT(SAMPLE_KEY(FEED_MOISTURE)),
+    ADA_FRAGMENT(SAMPLE_KEY(FEED_WATER_LEVEL)),
+};
+
+static const char *const feed_json_topics[UPLOAD_FEED_COUNT] = {
+    FEED_JSON_TOPIC(FEED_TEMPERATURE), FEED_JSON_TOPIC(FEED_LIGHT), FEED_JSON_TOPIC(FEED_HUMIDITY),
+    FEED_JSON_TOPIC(FEED_MOISTURE), FEED_JSON_TOPIC(FEED_WATER_LEVEL),
+};
+
+static esp_mqtt_client_handle_t mqtt_client = NULL;
+static atomic_bool mqtt_connected = false; //written by the mqtt task, read by the rx/tx tasks
+static SemaphoreHandle_t thresh_update_sem; //given by the event handler when a threshold arrives
+static int64_t connect_start = 0; //when the client began (re)connecting, only touched by the mqtt task
+
+static portMUX_TYPE pending_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint8_t pending_mask = 0; //bit per threshold feed with an unapplied value
+static char pending_values[THRESHOLD_FEED_COUNT][THRESHOLD_VALUE_MAX + 1];
+
+static portMUX_TYPE puback_lock = portMUX_INITIALIZER_UNLOCKED;
+static SemaphoreHandle_t puback_sem; //given by the event handler on every PUBACK
+static int acked_ids[ACKED_IDS_MAX]; //msg_ids acked since the running batch started, only a batch reads them
+static size_t acked_count = 0;
+
+static void on_published(int msg_id) { //a PUBACK can beat esp_mqtt_client_publish() back to its caller, so every id is kept
+    portENTER_CRITICAL(&puback_lock);
+    if (acked_count < ACKED_IDS_MAX) acked_ids[acked_count++] = msg_id;
+    portEXIT_CRITICAL(&puback_lock);
+    xSemaphoreGive(puback_sem);
+}
+
+static bool is_acked(int msg_id) {
+    bool found = false;
+    portENTER_CRITICAL(&puback_lock);
+    for (size_t i = 0; i < acked_count && !found; i++) found = acked_ids[i] == msg_id;
+    portEXIT_CRITICAL(&puback_lock);
+    return found;
+}
+
+static void subscribe_thresholds(void) {
+    char topic[128];
+    for (int i = 0; i < THRESHOLD_FEED_COUNT; i++) {
+        snprintf(topic, sizeof(topic), "%s/feeds/%s.%s", AIO_USERNAME, GROUP_THRESHOLDS, threshold_feed_keys[i]);
+        esp_mqtt_client_subscribe(mqtt_client, topic, 1);
+
+        strlcat(topic, "/get", sizeof(topic)); //asks the broker to resend the current value
+        esp_mqtt_client_publish(mqtt_client, topic, "", 0, 0, 0);
+    }
+}
+
+static void on_threshold_data(const esp_mqtt_event_handle_t event) {
+    if (event->current_data_offset != 0 || event->data_len != event->total_data_len) return; //threshold values never span messages
+
+    char topic[128];
+    if (event->topic_len <= 0 || event->topic_len >= (int)sizeof(topic) || event->data_len > THRESHOLD_VALUE_MAX) return;
+    memcpy(topic, event->topic, event->topic_len);
+    topic[event->topic_len] = '\0';
+
+    const char *feed_key = strrchr(topic, '/'); //".../feeds/<group>.<feed>"
+    int feed = threshold_feed_index((feed_key != NULL) ? feed_key + 1 : topic);
+    if (feed < 0) return;
+
+    portENTER_CRITICAL(&pending_lock);
+    memcpy(pending_values[feed], event->data, event->data_len);
+    pending_values[feed][event->data_len] = '\0';
+    pending_mask |= 1u << feed;
+    portEXIT_CRITICAL(&pending_lock);
+
+    xSemaphoreGive(thresh_update_sem);
+}
+
+static void mqtt_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data) {
+    esp_mqtt_event_handle_t event = (esp_mqtt_event_handle_t)event_data;
+
+    switch ((esp_mqtt_event_id_t)event_id) {
+        case MQTT_EVENT_BEFORE_CONNECT:
+            connect_start = esp_timer_get_time();
+            break;
+        case MQTT_EVENT_CONNECTED:
+            perf_record_latency(PERF_LAT_CONNECT, esp_timer_get_time() - connect_start); //TCP, TLS and the MQTT CONNACK
+            printf(" MQTT UPDATE: connected to adafruit\n");
+            atomic_store(&mqtt_connected, true);
+            subscribe_thresholds(); //clean session, so subscriptions are renewed on every connect
+            break;
+        case MQTT_EVENT_DISCONNECTED:
+            if (atomic_exchange(&mqtt_connected, false)) printf(" MQTT UPDATE: connection to adafruit lost\n"); //the client reconnects on its own
+            break;
+        case MQTT_EVENT_DATA:
+            on_threshold_data(event);
+            break;
+        case MQTT_EVENT_PUBLISHED:
+            on_published(event->msg_id);
+            break;
+        default:
+            break;
+    }
+}
+
+static bool mqtt_start(void) {
+    thresh_update_sem = xSemaphoreCreateBinary();
+    puback_sem = xSemaphoreCreateBinary();
+    if (thresh_update_sem == NULL || puback_sem == NULL || !ada_tls_init()) return false;
+
+    esp_mqtt_client_config_t config = {
+        .broker.address.uri = ADA_MQTT_URI,
+        .credentials.username = AIO_USERNAME,
+        .credentials.authentication.password = AIO_KEY,
+        .session.keepalive = ADA_MQTT_KEEPALIVE_S,
+        .outbox.limit = ADA_MQTT_OUTBOX_LIMIT, //unacked QoS 1 publishes held for resend
+    };
+    ada_tls_apply_mqtt(&config); //pinned CA or the bundle
+
+    mqtt_client = esp_mqtt_client_init(&config);
+    if (mqtt_client == NULL) return false;
+
+    esp_mqtt_client_register_event(mqtt_client, (esp_mqtt_event_id_t)ESP_EVENT_ANY_ID, mqtt_event_handler, NULL);
+    return esp_mqtt_client_start(mqtt_client) == ESP_OK; //connects once wifi is up, retries in the background
+}
+
+static int publish_id(const char *topic, const char *payload, int len) { //the QoS 1 msg_id, -1 if it wasn't sent
+    if (!atomic_load(&mqtt_connected)) return -1; //callers keep the sample in the offline log instead
+    int64_t start = esp_timer_get_time();
+    int msg_id = esp_mqtt_client_publish(mqtt_client, topic, payload, len, 1, 0); //blocks until written to the socket, not until acked
+    perf_record_latency(PERF_LAT_PUBLISH, esp_timer_get_time() - start);
+    return msg_id;
+}
+
+static bool publish(const char *topic, const char *payload, int len) { //len 0 = NUL terminated
+    return publish_id(topic, payload, len) >= 0;
+}
+
+static size_t put_group_payload(const UploadSample *sample, char *payload, int *sent) { //payload holds GROUP_PAYLOAD_MAX
+    size_t len = ADA_PUT_LITERAL(payload, SAMPLE_HEAD);
+    *sent = 0;
+    for (int feed = 0; feed < UPLOAD_FEED_COUNT; feed++) {
+        if (!(sample->feeds & (1u << feed))) continue; //unchanged since the last upload
+        if ((*sent)++ > 0) len += ADA_PUT_LITERAL(payload + len, "\", ");
+        len += ADA_PUT_FRAGMENT(payload + len, sample_keys[feed]);
+        len += ada_put_feed_value(&sample->data, feed, payload + len);
+    }
+    len += ADA_PUT_LITERAL(payload + len, "\"}}");
+    return len;
+}
+
+static bool mqtt_publish_sample(const UploadSample *sample) {
+    char payload[GROUP_PAYLOAD_MAX];
+    int sent;
+    size_t len = put_group_payload(sample, payload, &sent);
+    if (sent == 0) return true;
+
+    bool ok = publish(SAMPLE_TOPIC, payload, (int)len);
+    if (ok) {
+        printf(" SUCCESSFULLY published %d feeds to adafruit\n", sent);
+    } else {
+        printf(" FAILED to publish data to adafruit\n");
+    }
+    return ok;
+}
+
+static bool mqtt_publish_batch(UploadSample *samples, size_t count) {
+    char payload[GROUP_PAYLOAD_MAX]; //also fits one feed's json message
+    int msg_ids[BATCH_PUBLISH_MAX];
+    uint8_t msg_sample[BATCH_PUBLISH_MAX], msg_feeds[BATCH_PUBLISH_MAX]; //what each publish carried
+    size_t sent = 0;
+    bool all_written = true;
+    if (count > ADA_BATCH_MAX_SAMPLES) return false;
+
+    portENTER_CRITICAL(&puback_lock); //only acks from here on can belong to this batch
+    acked_count = 0;
+    portEXIT_CRITICAL(&puback_lock);
+    xSemaphoreTake(puback_sem, 0);
+
+    for (size_t i = 0; i < count && all_written; i++) {
+        if (samples[i].created_at == 0) { //no timestamp to keep, the group message is cheaper
+            int feeds;
+            size_t len = put_group_payload(&samples[i], payload, &feeds);
+            if (feeds == 0) continue;
+            msg_ids[sent] = publish_id(SAMPLE_TOPIC, payload, (int)len);
+            if (msg_ids[sent] < 0) {
+                printf(" FAILED to publish data to adafruit\n");
+                all_written = false;
+                break;
+            }
+            msg_sample[sent] = (uint8_t)i;
+            msg_feeds[sent++] = samples[i].feeds;
+            continue;
+        }
+
+        char stamp[ADA_CREATED_AT_LEN];
+        size_t stamp_len = ada_put_created_at(samples[i].created_at, stamp);
+
+        for (int feed = 0; feed < UPLOAD_FEED_COUNT; feed++) {
+            if (!(samples[i].feeds & (1u << feed))) continue;
+            size_t len = ADA_PUT_LITERAL(payload, "{\"value\": \"");
+            len += ada_put_feed_value(&samples[i].data, feed, payload + len);
+            len += ADA_PUT_LITERAL(payload + len, "\", \"created_at\": \"");
+            memcpy(payload + len, stamp, stamp_len);
+            len += stamp_len;
+            len += ADA_PUT_LITERAL(payload + len, "\"}");
+
+            msg_ids[sent] = publish_id(feed_json_topics[feed], payload, (int)len);
+            if (msg_ids[sent] < 0) {
+                printf(" FAILED to publish %s sample to adafruit\n", ada_upload_feed_keys[feed]);
+                all_written = false; //what was written still counts once its PUBACK is in, the rest is retried later
+                break;
+            }
+            msg_sample[sent] = (uint8_t)i;
+            msg_feeds[sent++] = 1u << feed;
+        }
+    }
+
+    //written to the socket is not delivered, only a PUBACK lets a feed leave the batch (and the offline log)
+    TickType_t deadline = xTaskGetTickCount() + pdMS_TO_TICKS(ADA_MQTT_PUBACK_WAIT_MS);
+    size_t acked = 0;
+    while (1) {
+        acked = 0;
+        for (size_t m = 0; m < sent; m++) acked += is_acked(msg_ids[m]) ? 1 : 0;
+        TickType_t now = xTaskGetTickCount();
+        if (acked == sent || (int32_t)(deadline - now) <= 0) break;
+        xSemaphoreTake(puback_sem, deadline - now);
+    }
+    for (size_t m = 0; m < sent; m++) {
+        if (is_acked(msg_ids[m])) samples[msg_sample[m]].feeds &= ~msg_feeds[m];
+    }
+
+    if (!all_written || acked < sent) {
+        if (acked < sent) printf(" %u of %u publishes to adafruit not acked in time\n", (unsigned)(sent - acked), (unsigned)sent);
+        return false;
+    }
+    printf(" SUCCESSFULLY published %u samples to adafruit\n", (unsigned)count);
+    return true;
+}
+
+static PullResult mqtt_pull_thresholds(ThresholdData *thresh, TickType_t wait) {
+    if (xSemaphoreTake(thresh_update_sem, wait) != pdTRUE) {
+        return atomic_load(&mqtt_connected) ? PULL_UNCHANGED : PULL_FAILED;
+    }
+
+    char values[THRESHOLD_FEED_COUNT][THRESHOLD_VALUE_MAX + 1];
+    portENTER_CRITICAL(&pending_lock); //take everything that arrived so far in one go
+    uint8_t mask = pending_mask;
+    pending_mask = 0;
+    memcpy(values, pending_values, sizeof(values));
+    portEXIT_CRITICAL(&pending_lock);
+
+    if (mask == 0) return PULL_UNCHANGED;
+
+    for (int i = 0; i < THRESHOLD_FEED_COUNT; i++) {
+        if (mask & (1u << i)) threshold_apply_value(thresh, i, values[i]);
+    }
+    printf(" received thresholds light: %d moist: %d temp: %d toggle: %d light hours: %.1f water now: %d\n",
+           thresh->light_intensity, thresh->moisture, thresh->temperature, thresh->on_off_toggle, thresh->light_hours, thresh->water_now);
+    return PULL_UPDATED;
+}
+
+static bool mqtt_publish_feed(const char *feed_key, const char *value) {
+    char topic[128];
+    snprintf(topic, sizeof(topic), AIO_USERNAME "/feeds/%s", feed_key); //feed keys vary, this one is still formatted
+    return publish(topic, value, 0);
+}
+
+static bool mqtt_reset_water_now(void) {
+    bool ok = publish(WATER_NOW_TOPIC, "0", 1);
+    if (ok) {
+        printf(" SUCCESSFULLY reset Adafruit water-now button to 0\n");
+    } else {
+        printf(" FAILED to reset Adafruit water-now button\n");
+    }
+    return ok;
+}
+
+const AdaTransport ada_mqtt_transport = {
+    .name = "mqtt",
+    .start = mqtt_start,
+    .publish_sample = mqtt_publish_sample,
+    .publish_batch = mqtt_publish_batch,
+    .pull_thresholds = mqtt_pull_thresholds,
+    .reset_water_now = mqtt_reset_water_now,
+    .publish_feed = mqtt_publish_feed,
+};
@@ -0,0 +1,51 @@
+#include "ada_tls.h"
+#include <stdio.h>
+#include "esp_tls.h"
+#include "esp_crt_bundle.h"
+#include "constants.h"
+
+#if ADA_TLS_PIN_CA && defined(ADA_TLS_HAVE_PINNED_CA) //the define comes from main/CMakeLists.txt when the PEM exists
+#define PINNED 1
+extern const uint8_t adafruit_io_ca_pem_start[] asm("_binary_adafruit_io_ca_pem_start");
+extern const uint8_t adafruit_io_ca_pem_end[] asm("_binary_adafruit_io_ca_pem_end");
+#else
+#define PINNED 0
+#endif
+
+static bool pinned = false;
+
+bool ada_tls_init(void) {
+#if PINNED
+    if (esp_tls_init_global_ca_store() != ESP_OK) return false;
+    //embedded as text, so the length includes the NUL mbedtls needs to recognise PEM
+    if (esp_tls_set_global_ca_store(adafruit_io_ca_pem_start, adafruit_io_ca_pem_end - adafruit_io_ca_pem_start) != ESP_OK) {
+        printf("error: pinned adafruit CA failed to parse\n");
+        return false;
+    }
+    pinned = true;
+    printf("TLS: verifying adafruit against the pinned CA\n");
+#elif ADA_TLS_PIN_CA
+    printf("TLS: no pinned CA built in (main/certs/adafruit_io_ca.pem), using the CA bundle\n");
+#endif
+    return true;
+}
+
+bool ada_tls_pinned(void) {
+    return pinned;
+}
+
+void ada_tls_apply_http(esp_http_client_config_t *config) {
+    if (pinned) {
+        config->use_global_ca_store = true;
+    } else {
+        config->crt_bundle_attach = esp_crt_bundle_attach;
+    }
+}
+
+void ada_tls_apply_mqtt(esp_mqtt_client_config_t *config) {
+    if (pinned) {
+        config->broker.verification.use_global_ca_store = true;
+    } else {
+        config->broker.verification.crt_bundle_attach = esp_crt_bundle_attach;
+    }
+}
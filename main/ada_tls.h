@@ -0,0 +1,17 @@
+#ifndef ADA_TLS_H
+#define ADA_TLS_H
+
+#include <stdbool.h>
+#include "esp_http_client.h"
+#include "mqtt_client.h"
+
+//server verification for both adafruit backends. with ADA_TLS_PIN_CA and main/certs/adafruit_io_ca.pem present at
+//build time, the pinned CA is parsed once into the esp-tls global store and every session (http, mqtt, reconnects)
+//verifies against that one parsed copy. without it the common CA bundle is attached per session as before.
+
+bool ada_tls_init(void); //once, before the transport starts
+bool ada_tls_pinned(void);
+void ada_tls_apply_http(esp_http_client_config_t *config);
+void ada_tls_apply_mqtt(esp_mqtt_client_config_t *config);
+
+#endif
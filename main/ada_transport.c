@@ -0,0 +1,97 @@
+#include "ada_transport.h"
+#include <string.h>
+#include <time.h>
+#include "constants.h"
+#include "secrets.h"
+
+const char *const ada_upload_feed_keys[UPLOAD_FEED_COUNT] = { //same order as ada_format_feed_value()
+    FEED_TEMPERATURE, FEED_LIGHT, FEED_HUMIDITY, FEED_MOISTURE, FEED_WATER_LEVEL
+};
+
+const AdaTransport *ada_transport_get(void) {
+#if ADA_TRANSPORT_MQTT
+    return &ada_mqtt_transport;
+#else
+    return &ada_http_transport;
+#endif
+}
+
+size_t ada_put_u32(char *out, uint32_t value) {
+    char digits[10];
+    size_t n = 0;
+    do {
+        digits[n++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+    for (size_t i = 0; i < n; i++) out[i] = digits[n - 1 - i];
+    return n;
+}
+
+static size_t put_deci(char *out, int32_t deci) { //tenths as "-12.3", exact where "%.2f" of a float was not
+    size_t n = 0;
+    uint32_t magnitude = (deci < 0) ? (uint32_t)-(int64_t)deci : (uint32_t)deci;
+    if (deci < 0) out[n++] = '-';
+    n += ada_put_u32(out + n, magnitude / 10);
+    out[n++] = '.';
+    out[n++] = (char)('0' + magnitude % 10);
+    return n;
+}
+
+static char *put_2(char *out, int value) {
+    out[0] = (char)('0' + value / 10 % 10);
+    out[1] = (char)('0' + value % 10);
+    return out + 2;
+}
+
+size_t ada_put_feed_value(const SensorData *data, int feed, char *out) {
+    switch (feed) {
+        case 0: return put_deci(out, data->temperature_raw); //raw bus value, the float is never formatted
+        case 1: return ada_put_u32(out, data->light_level);
+        case 2: return ada_put_u32(out, data->humidity);
+        case 3: return ada_put_u32(out, data->moisture);
+        default:
+            out[0] = data->water_level ? '1' : '0';
+            return 1;
+    }
+}
+
+size_t ada_put_created_at(int64_t created_at, char *out) {
+    time_t t = (time_t)created_at;
+    struct tm timeinfo;
+    gmtime_r(&t, &timeinfo);
+
+    int year = timeinfo.tm_year + 1900;
+    char *p = put_2(put_2(out, year / 100), year % 100);
+    *p++ = '-';
+    p = put_2(p, timeinfo.tm_mon + 1);
+    *p++ = '-';
+    p = put_2(p, timeinfo.tm_mday);
+    *p++ = 'T';
+    p = put_2(p, timeinfo.tm_hour);
+    *p++ = ':';
+    p = put_2(p, timeinfo.tm_min);
+    *p++ = ':';
+    p = put_2(p, timeinfo.tm_sec);
+    *p++ = 'Z';
+    return p - out;
+}
+
+int ada_format_feed_value(const SensorData *data, int feed, char *buf, size_t len) {
+    char value[ADA_SAMPLE_VALUE_MAX];
+    size_t n = ada_put_feed_value(data, feed, value);
+    if (len > 0) {
+        size_t copy = (n < len) ? n : len - 1;
+        memcpy(buf, value, copy);
+        buf[copy] = '\0';
+    }
+    return (int)n; //like snprintf, the untruncated length
+}
+
+void ada_format_created_at(int64_t created_at, char *buf, size_t len) {
+    char stamp[ADA_CREATED_AT_LEN];
+    size_t n = ada_put_created_at(created_at, stamp);
+    if (len == 0) return;
+    if (n >= len) n = len - 1;
+    memcpy(buf, stamp, n);
+    buf[n] = '\0';
+}
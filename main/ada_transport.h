@@ -0,0 +1,60 @@
+#ifndef ADA_TRANSPORT_H
+#define ADA_TRANSPORT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "plant_types.h"
+#include "upload_filter.h"
+#include "secrets.h"
+
+//backend used by the adafruit rx/tx tasks, picked at build time with ADA_TRANSPORT_MQTT.
+//http sends one HTTPS request per call, mqtt keeps one TLS connection open for everything.
+
+#define ADA_FEED_VALUE_MAX 1024 //adafruit io rejects longer feed values
+#define ADA_SAMPLE_VALUE_MAX 11 //longest value ada_put_feed_value writes ("-3276.8", "65535", a full uint32 for new feeds)
+#define ADA_CREATED_AT_LEN 20 //"YYYY-MM-DDTHH:MM:SSZ"
+#define ADA_API_URL "https://io.adafruit.com/api/v2/" AIO_USERNAME //the secrets are literals, so every URL is put together at compile time
+
+typedef enum {
+    PULL_FAILED = -1,
+    PULL_UNCHANGED,
+    PULL_UPDATED,
+} PullResult;
+
+typedef struct {
+    const char *name;
+    bool (*start)(void); //called once before the tasks are created
+    bool (*publish_sample)(const UploadSample *sample); //only the feeds in sample->feeds
+    bool (*publish_batch)(UploadSample *samples, size_t count); //clears the feeds bits it is done with, sent or refused for good, true if all were sent
+    PullResult (*pull_thresholds)(ThresholdData *thresh, TickType_t wait); //waits up to wait for new thresholds, updates thresh in place
+    bool (*reset_water_now)(void);
+    bool (*publish_feed)(const char *feed_key, const char *value); //one value to any feed, value must not need json escaping
+} AdaTransport;
+
+extern const AdaTransport ada_http_transport;
+extern const AdaTransport ada_mqtt_transport;
+
+const AdaTransport *ada_transport_get(void);
+
+//payload helpers shared by both backends. the put functions write straight into the caller's buffer with
+//integer formatting and return the length, nothing is NUL terminated and printf is never involved.
+extern const char *const ada_upload_feed_keys[UPLOAD_FEED_COUNT];
+size_t ada_put_u32(char *out, uint32_t value); //out holds 10 chars
+size_t ada_put_feed_value(const SensorData *data, int feed, char *out); //out holds ADA_SAMPLE_VALUE_MAX chars
+size_t ada_put_created_at(int64_t created_at, char *out); //ISO 8601 in UTC, as adafruit expects, out holds ADA_CREATED_AT_LEN chars
+int ada_format_feed_value(const SensorData *data, int feed, char *buf, size_t len); //NUL terminated versions of the above
+void ada_format_created_at(int64_t created_at, char *buf, size_t len);
+
+typedef struct { //fixed payload text with its length worked out at compile time
+    const char *text;
+    size_t len;
+} AdaFragment;
+
+#define ADA_FRAGMENT(text) { text, sizeof(text) - 1 }
+#define ADA_PUT_LITERAL(out, text) (memcpy((out), (text), sizeof(text) - 1), sizeof(text) - 1) //evaluates to the length copied
+#define ADA_PUT_FRAGMENT(out, frag) (memcpy((out), (frag).text, (frag).len), (frag).len)
+
+#endif
@@ -0,0 +1,19 @@
+#include "can_nodes.h"
+
+twai_filter_config_t can_nodes_filter_config(void) {
+    uint32_t common_bits = 0x7FF; //11-bit ID bits that are identical across every registered node
+
+    for (int i = 1; i < (int)CAN_NODE_COUNT; i++) {
+        common_bits &= ~(can_node_ids[i] ^ can_node_ids[0]);
+    }
+
+    //single filter, standard frame: ID sits in bits 31..21, a mask bit of 1 means "don't care".
+    //RTR and the two data bytes covered by the filter are always don't care.
+    twai_filter_config_t f_config = {
+        .acceptance_code = (can_node_ids[0] & common_bits) << 21,
+        .acceptance_mask = ((~common_bits & 0x7FF) << 21) | 0x1FFFFF,
+        .single_filter = true,
+    };
+
+    return f_config; //IDs that share the mask but aren't registered are still dropped by can_node_slot()
+}
@@ -0,0 +1,9 @@
+#ifndef CAN_NODES_H
+#define CAN_NODES_H
+
+#include "driver/twai.h"
+#include "can_frame.h"
+
+twai_filter_config_t can_nodes_filter_config(void); //acceptance filter covering every ID in the registry
+
+#endif
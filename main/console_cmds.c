@@ -0,0 +1,126 @@
+#include "console_cmds.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_console.h"
+#include "perf_stats.h"
+#include "pump_driver.h"
+#include "plant_control.h"
+#include "tunables.h"
+#include "ota_update.h"
+
+static int cmd_stats(int argc, char **argv) {
+    char *report = malloc(1536); //only while the command runs, the console task stack stays small
+    if (report == NULL) return 1;
+    perf_format_report(report, 1536);
+    fputs(report, stdout);
+    free(report);
+    return 0;
+}
+
+static int cmd_pump(int argc, char **argv) {
+    if (argc == 4 && strcmp(argv[1], "cal") == 0) { //measured by timing a known volume
+        int zone = atoi(argv[2]);
+        uint32_t ul_per_s = (uint32_t)(strtof(argv[3], NULL) * 1000.0f + 0.5f);
+        esp_err_t err = pump_cal_set(zone, ul_per_s);
+        if (err == ESP_ERR_INVALID_ARG) {
+            printf("zone must be 0..%d and the flow above 0\n", (int)ZONE_COUNT - 1);
+            return 1;
+        }
+        if (err != ESP_OK) printf("flow applied but not saved (%s)\n", esp_err_to_name(err));
+    } else if (argc != 1) {
+        printf("usage: pump [cal <zone> <mL/s>]\n");
+        return 1;
+    }
+    for (int z = 0; z < (int)ZONE_COUNT; z++) {
+        uint32_t flow = pump_cal_get(z);
+        printf("zone %d: %u.%03u mL/s, %d mL dose runs %u ms\n", z, (unsigned)(flow / 1000), (unsigned)(flow % 1000),
+               (int)tunable_get(TUNE_PUMP_DOSE_ML), (unsigned)(pump_dose_run_us(z) / 1000));
+    }
+    return 0;
+}
+
+static int cmd_tune(int argc, char **argv) {
+    if (argc == 3) {
+        int which = tunable_find(argv[1]);
+        if (which < 0) {
+            printf("no tunable named '%s'\n", argv[1]);
+            return 1;
+        }
+        esp_err_t err;
+        if (strcmp(argv[2], "default") == 0) {
+            err = tunable_reset(which);
+        } else {
+            char *end;
+            unsigned long value = strtoul(argv[2], &end, 10);
+            err = (*end == '\0' && end != argv[2]) ? tunable_set(which, (uint32_t)value) : ESP_ERR_INVALID_ARG;
+        }
+        if (err == ESP_ERR_INVALID_ARG) {
+            uint32_t min, max, def;
+            tunable_range(which, &min, &max, &def);
+            printf("%s must be %u..%u\n", argv[1], (unsigned)min, (unsigned)max);
+            return 1;
+        }
+        if (err != ESP_OK) printf("value applied but not saved (%s)\n", esp_err_to_name(err));
+    } else if (argc != 1) {
+        printf("usage: tune [<name> <value>|default]\n");
+        return 1;
+    }
+    for (int i = 0; i < TUNE_COUNT; i++) {
+        uint32_t min, max, def;
+        tunable_range(i, &min, &max, &def);
+        printf("%-10s %u (default %u, %u..%u)\n", tunable_name(i), (unsigned)tunable_get(i), (unsigned)def, (unsigned)min, (unsigned)max);
+    }
+    return 0;
+}
+
+static int cmd_ota(int argc, char **argv) {
+    if (argc == 2 && strcmp(argv[1], "check") == 0) {
+        if (!ota_update_check_now()) {
+            printf("updates are off (OTA_ENABLE or OTA_URL)\n");
+            return 1;
+        }
+    } else if (argc != 1) {
+        printf("usage: ota [check]\n");
+        return 1;
+    }
+    ota_update_print_status();
+    return 0;
+}
+
+bool console_init(void) {
+    esp_console_repl_t *repl = NULL;
+    esp_console_repl_config_t repl_config = ESP_CONSOLE_REPL_CONFIG_DEFAULT();
+    repl_config.prompt = "plant>";
+    esp_console_dev_uart_config_t uart_config = ESP_CONSOLE_DEV_UART_CONFIG_DEFAULT();
+
+    if (esp_console_new_repl_uart(&uart_config, &repl_config, &repl) != ESP_OK) return false;
+
+    const esp_console_cmd_t stats_cmd = {
+        .command = "stats",
+        .help = "print latency histograms, counters and memory watermarks",
+        .func = cmd_stats,
+    };
+    esp_console_cmd_register(&stats_cmd);
+    const esp_console_cmd_t pump_cmd = {
+        .command = "pump",
+        .help = "show pump flow calibration, 'pump cal <zone> <mL/s>' sets it",
+        .func = cmd_pump,
+    };
+    esp_console_cmd_register(&pump_cmd);
+    const esp_console_cmd_t tune_cmd = {
+        .command = "tune",
+        .help = "list runtime tunables, 'tune <name> <value>' stores one, 'tune <name> default' clears it",
+        .func = cmd_tune,
+    };
+    esp_console_cmd_register(&tune_cmd);
+    const esp_console_cmd_t ota_cmd = {
+        .command = "ota",
+        .help = "show the running image, 'ota check' polls for an update now",
+        .func = cmd_ota,
+    };
+    esp_console_cmd_register(&ota_cmd);
+    esp_console_register_help_command();
+
+    return esp_console_start_repl(repl) == ESP_OK;
+}
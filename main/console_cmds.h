@@ -0,0 +1,13 @@
+#ifndef CONSOLE_CMDS_H
+#define CONSOLE_CMDS_H
+
+#include <stdbool.h>
+
+//serial console on the default UART. commands:
+//  stats  - latency histograms, counters, task stack and heap watermarks
+//  pump   - flow calibration and dose run time per zone, "pump cal <zone> <mL/s>" stores a measured flow
+//  tune   - lux targets, pump cooldown and dose, "tune <name> <value>" stores one in NVS over the build default
+//  ota    - running image and trial state, "ota check" looks for new firmware right away
+bool console_init(void);
+
+#endif
@@ -0,0 +1,42 @@
+#include "light_lut_store.h"
+#include <stdio.h>
+#include "nvs.h"
+#include "constants.h"
+
+#define LUT_NVS_NAMESPACE "light"
+#define LUT_NVS_KEY "lut"
+
+static void lut_key(int zone, char *key, size_t len) {
+    if (zone == 0) snprintf(key, len, LUT_NVS_KEY); //zone 0 keeps the key from before zones existed
+    else snprintf(key, len, LUT_NVS_KEY "%d", zone);
+}
+
+esp_err_t light_lut_load(int zone, LightLut *lut) {
+    char key[16];
+    lut_key(zone, key, sizeof(key));
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(LUT_NVS_NAMESPACE, NVS_READONLY, &handle);
+    if (err != ESP_OK) return err;
+
+    LightLut stored;
+    size_t len = sizeof(stored);
+    err = nvs_get_blob(handle, key, &stored, &len);
+    nvs_close(handle);
+
+    if (err == ESP_OK && (len != sizeof(stored) || stored.level_max != LIGHT_LEVEL_MAX)) err = ESP_ERR_INVALID_SIZE; //measured with a different table layout
+    if (err == ESP_OK) *lut = stored;
+    return err;
+}
+
+esp_err_t light_lut_save(int zone, const LightLut *lut) {
+    char key[16];
+    lut_key(zone, key, sizeof(key));
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(LUT_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err != ESP_OK) return err;
+
+    err = nvs_set_blob(handle, key, lut, sizeof(*lut));
+    if (err == ESP_OK) err = nvs_commit(handle);
+    nvs_close(handle);
+    return err;
+}
@@ -0,0 +1,11 @@
+#ifndef LIGHT_LUT_STORE_H
+#define LIGHT_LUT_STORE_H
+
+#include "esp_err.h"
+#include "light_control.h"
+
+//measured lux -> level table per zone, kept in NVS across reboots
+esp_err_t light_lut_load(int zone, LightLut *lut); //leaves lut untouched if there is none
+esp_err_t light_lut_save(int zone, const LightLut *lut);
+
+#endif
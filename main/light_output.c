@@ -0,0 +1,113 @@
+#include "light_output.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include "driver/ledc.h"
+#include "esp_pm.h"
+#include "constants.h"
+#include "light_gamma.h" //generated by tools/gen_light_gamma.py
+
+typedef struct {
+    int gpio;
+    uint16_t share_q8; //channel duty relative to the level, 256 = full
+    uint8_t fixture;
+} LightChannel;
+
+static const LightChannel light_channels[] = LIGHT_CHANNELS;
+#define LIGHT_CHANNEL_COUNT (sizeof(light_channels) / sizeof(light_channels[0]))
+
+_Static_assert(LIGHT_GAMMA_LEVELS == LIGHT_LEVEL_MAX + 1, "gamma table built for a different LIGHT_LEVEL_MAX");
+_Static_assert(LIGHT_GAMMA_DUTY_BITS == LIGHT_PWM_BITS, "gamma table built for a different LIGHT_PWM_BITS");
+_Static_assert(LIGHT_CHANNEL_COUNT <= LEDC_CHANNEL_MAX, "more light channels than LEDC channels");
+
+static uint32_t last_level[LIGHT_FIXTURE_MAX];
+static bool level_known[LIGHT_FIXTURE_MAX]; //covers the startup edge case, first set always goes out
+static int fixtures_lit = 0;
+#if CONFIG_PM_ENABLE
+static esp_pm_lock_handle_t light_pm_lock; //LEDC runs off APB, light sleep would freeze the PWM while any fixture is lit
+#endif
+
+void light_output_init(void) {
+    ledc_timer_config_t ledc_timer = {  //configurations for LEDC Timer for PWM
+        .speed_mode       = LEDC_LOW_SPEED_MODE,
+        .timer_num        = LEDC_TIMER_0,
+        .duty_resolution  = LIGHT_PWM_BITS,
+        .freq_hz          = LIGHT_PWM_FREQ_HZ,
+        .clk_cfg          = LEDC_AUTO_CLK
+    };
+    ledc_timer_config(&ledc_timer);
+
+    for (int i = 0; i < (int)LIGHT_CHANNEL_COUNT; i++) { //all channels share the one timer
+        if (light_channels[i].fixture >= LIGHT_FIXTURE_MAX) {
+            printf("error: light channel %d belongs to fixture %u, only %d are supported\n", i, light_channels[i].fixture, LIGHT_FIXTURE_MAX);
+            continue;
+        }
+        ledc_channel_config_t ledc_channel = {
+            .speed_mode     = LEDC_LOW_SPEED_MODE,
+            .channel        = (ledc_channel_t)i,
+            .timer_sel      = LEDC_TIMER_0,
+            .intr_type      = LEDC_INTR_DISABLE,
+            .gpio_num       = light_channels[i].gpio,
+            .duty           = 0, //start with 0% duty cycle (off)
+            .hpoint         = 0
+        };
+        ledc_channel_config(&ledc_channel);
+    }
+
+    ledc_fade_func_install(0);
+
+#if CONFIG_PM_ENABLE
+    esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "light_pwm", &light_pm_lock);
+#endif
+}
+
+uint32_t light_output_duty(uint32_t level) {
+    if (level > LIGHT_LEVEL_MAX) level = LIGHT_LEVEL_MAX;
+    return light_gamma_table[level];
+}
+
+void light_output_set(int fixture, uint32_t level) {
+    if (fixture < 0 || fixture >= LIGHT_FIXTURE_MAX) return;
+    if (level > LIGHT_LEVEL_MAX) level = LIGHT_LEVEL_MAX;
+    bool known = level_known[fixture];
+    uint32_t last = known ? last_level[fixture] : 0;
+    if (known && level == last) return;
+
+    int level_diff = abs((int)level - (int)last); //size of jump
+    int fade_time = (level_diff * 3000) / LIGHT_LEVEL_MAX; //scale the time of the jump
+    uint32_t duty = light_output_duty(level);
+
+    bool was_lit = known && last > 0;
+    if (level > 0 && !was_lit && fixtures_lit++ == 0) {
+#if CONFIG_PM_ENABLE
+        esp_pm_lock_acquire(light_pm_lock); //stay awake while lit
+#endif
+    }
+
+    for (int i = 0; i < (int)LIGHT_CHANNEL_COUNT; i++) { //queued back to back, the fade engine runs them in parallel
+        if (light_channels[i].fixture != fixture) continue;
+        ledc_channel_t channel = (ledc_channel_t)i;
+        uint32_t channel_duty = (duty * light_channels[i].share_q8) >> 8;
+
+        if (level == 0) {
+            ledc_stop(LEDC_LOW_SPEED_MODE, channel, 0);
+        } else if (fade_time < 50) { //if jump too small, set instantly
+            ledc_set_duty_and_update(LEDC_LOW_SPEED_MODE, channel, channel_duty, 0);
+        } else {
+            ledc_set_fade_time_and_start(LEDC_LOW_SPEED_MODE, channel, channel_duty, fade_time, LEDC_FADE_NO_WAIT);
+        }
+    }
+
+    printf("led grow lights %d adjusted to level: %lu/%d (duty %lu)\n", fixture, level, LIGHT_LEVEL_MAX, duty);
+    if (level == 0 && was_lit && --fixtures_lit == 0) {
+#if CONFIG_PM_ENABLE
+        esp_pm_lock_release(light_pm_lock);
+#endif
+    }
+
+    last_level[fixture] = level;
+    level_known[fixture] = true;
+}
+
+int light_output_channel_count(void) {
+    return (int)LIGHT_CHANNEL_COUNT;
+}
@@ -0,0 +1,16 @@
+#ifndef LIGHT_OUTPUT_H
+#define LIGHT_OUTPUT_H
+
+#include <stdint.h>
+
+//grow light fixture driver. one light level per fixture in, every LEDC channel of that fixture out:
+//the level goes through the build-time gamma table, then each channel's spectrum share.
+
+#define LIGHT_FIXTURE_MAX 8 //one LEDC channel each at least
+
+void light_output_init(void);
+void light_output_set(int fixture, uint32_t level); //0..LIGHT_LEVEL_MAX, fades the fixture's channels together
+uint32_t light_output_duty(uint32_t level); //full-scale duty for a level, before the spectrum share
+int light_output_channel_count(void); //LEDC channels 0..count-1 belong to the lights
+
+#endif
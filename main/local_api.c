@@ -0,0 +1,259 @@
+#include "local_api.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "esp_http_server.h"
+#include "constants.h"
+#include "plant_control.h"
+#include "shared_state.h"
+#include "sensor_history.h"
+#include "can_frame.h"
+#include "threshold_parser.h"
+#include "secrets.h"
+
+#define LOCAL_API_FRAME_MAX 224 //longest sensor frame format_sensor writes
+#define LOCAL_API_STATS_MAX 512 //one zone's minute and hour aggregates
+#define LOCAL_API_STATE_MAX (192 + ZONE_COUNT * (LOCAL_API_FRAME_MAX + LOCAL_API_STATS_MAX))
+#define LOCAL_API_HISTORY_MAX 120 //values per /api/history answer
+
+static const char *const history_field_names[HISTORY_FIELD_COUNT] = { "temperature", "light", "humidity", "moisture" };
+static const char *const history_res_names[HISTORY_RES_COUNT] = { "minute", "hour" };
+
+typedef struct { //one broadcast, freed by the httpd task once every client has it
+    size_t len;
+    char text[LOCAL_API_FRAME_MAX];
+} WsMessage;
+
+static httpd_handle_t server = NULL;
+static local_api_thresholds_cb_t thresholds_cb = NULL;
+static atomic_int ws_clients = 0; //bumped on each handshake, recounted on every broadcast
+static int ws_writer; //address stored as the session context of websockets that passed the key check
+
+static void no_free(void *ctx) {} //the session context points at static data
+
+static size_t format_sensor(const SensorData *data, char *out, size_t len) {
+    int deci = data->temperature_raw;
+    int n = snprintf(out, len, "{\"node\": %u, \"seq\": %u, \"temperature\": %s%d.%d, \"light\": %u, \"humidity\": %u, \"moisture\": %u, "
+                     "\"water_level\": %d, \"ec\": %u, \"ph\": %u.%02u, \"co2\": %u, \"fields\": %u, \"known\": %u}",
+                     data->node, data->seq, (deci < 0) ? "-" : "", abs(deci) / 10, abs(deci) % 10, data->light_level, data->humidity,
+                     data->moisture, data->water_level ? 1 : 0, data->ec, data->ph_centi / 100, data->ph_centi % 100, data->co2, data->fields, data->known);
+    return (n < 0) ? 0 : ((size_t)n < len) ? (size_t)n : len - 1;
+}
+
+static size_t format_stats(uint8_t node, char *out, size_t len) { //last closed minute and hour, temperature in deci-degrees
+    size_t pos = 0;
+    for (int r = 0; r < HISTORY_RES_COUNT; r++) {
+        pos += (size_t)snprintf(out + pos, len - pos, "%s\"%s\": {", (r > 0) ? ", " : "", history_res_names[r]);
+        for (int f = 0; f < HISTORY_FIELD_COUNT && pos < len; f++) {
+            HistoryStat stat;
+            const char *sep = (f > 0) ? ", " : "";
+            if (sensor_history_stat(node, r, f, true, &stat)) {
+                pos += (size_t)snprintf(out + pos, len - pos, "%s\"%s\": {\"min\": %d, \"max\": %d, \"mean\": %d}", sep,
+                                        history_field_names[f], (int)stat.min, (int)stat.max, (int)stat.mean);
+            } else {
+                pos += (size_t)snprintf(out + pos, len - pos, "%s\"%s\": null", sep, history_field_names[f]); //window not closed yet
+            }
+            if (pos >= len) return len - 1;
+        }
+        pos += (size_t)snprintf(out + pos, len - pos, "}");
+        if (pos >= len) return len - 1;
+    }
+    return pos;
+}
+
+static size_t format_thresholds(const ThresholdData *thresh, char *out, size_t len) {
+    int n = snprintf(out, len, "{\"light-intensity\": %d, \"moisture\": %d, \"temperature\": %d, \"on-off-toggle\": %d, \"light-hours\": %.1f}",
+                     thresh->light_intensity, thresh->moisture, thresh->temperature, thresh->on_off_toggle, thresh->light_hours);
+    return (n < 0) ? 0 : ((size_t)n < len) ? (size_t)n : len - 1;
+}
+
+static int apply_thresholds(const char *body, size_t len) { //returns the number of thresholds applied, -1 for bad JSON
+    ThresholdData thresh = shared_thresholds_read(CAN_PRIMARY_NODE); //the cloud group is shared, so is a local write
+    thresh.water_now = 0;
+    ThresholdParser parser;
+    threshold_parser_init_flat(&parser, &thresh);
+    threshold_parser_feed(&parser, body, len);
+    int applied = threshold_parser_finish(&parser);
+    if (applied > 0 && thresholds_cb != NULL) thresholds_cb(&thresh, parser.applied_feeds);
+    return applied;
+}
+
+static bool write_allowed(httpd_req_t *req) {
+#ifdef LOCAL_API_KEY
+    char key[64];
+    if (httpd_req_get_hdr_value_str(req, "X-API-Key", key, sizeof(key)) == ESP_OK && strcmp(key, LOCAL_API_KEY) == 0) return true;
+    char query[96];
+    return httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK && //browsers can't set headers on a websocket
+           httpd_query_key_value(query, "key", key, sizeof(key)) == ESP_OK && strcmp(key, LOCAL_API_KEY) == 0;
+#else
+    return false; //no key configured, nothing on the LAN may change the thresholds
+#endif
+}
+
+static esp_err_t state_handler(httpd_req_t *req) {
+    char *body = malloc(LOCAL_API_STATE_MAX); //only while the request runs, the httpd stack stays small
+    if (body == NULL) return httpd_resp_send_500(req);
+
+    ThresholdData thresh = shared_thresholds_read(CAN_PRIMARY_NODE);
+    size_t len = (size_t)snprintf(body, LOCAL_API_STATE_MAX, "{\"thresholds\": ");
+    len += format_thresholds(&thresh, body + len, LOCAL_API_STATE_MAX - len);
+    len += (size_t)snprintf(body + len, LOCAL_API_STATE_MAX - len, ", \"zones\": [");
+    for (int z = 0; z < (int)ZONE_COUNT; z++) {
+        SensorData latest = shared_sensor_read(zone_config[z].node);
+        if (z > 0) len += (size_t)snprintf(body + len, LOCAL_API_STATE_MAX - len, ", ");
+        if (latest.raw_id == 0) { //nothing heard from that node yet
+            len += (size_t)snprintf(body + len, LOCAL_API_STATE_MAX - len, "null");
+            continue;
+        }
+        len += format_sensor(&latest, body + len, LOCAL_API_STATE_MAX - len) - 1; //reopen the object for the aggregates
+        len += (size_t)snprintf(body + len, LOCAL_API_STATE_MAX - len, ", \"history\": {");
+        len += format_stats(zone_config[z].node, body + len, LOCAL_API_STATE_MAX - len);
+        len += (size_t)snprintf(body + len, LOCAL_API_STATE_MAX - len, "}}");
+    }
+    len += (size_t)snprintf(body + len, LOCAL_API_STATE_MAX - len, "]}");
+
+    httpd_resp_set_type(req, "application/json");
+    esp_err_t err = httpd_resp_send(req, body, (len < LOCAL_API_STATE_MAX) ? (ssize_t)len : LOCAL_API_STATE_MAX - 1);
+    free(body);
+    return err;
+}
+
+static esp_err_t history_handler(httpd_req_t *req) { //?node=0&field=moisture&n=60, newest value first
+    char query[64], value[16];
+    int node = CAN_PRIMARY_NODE, field = HISTORY_FIELD_MOISTURE, count = LOCAL_API_HISTORY_MAX;
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        if (httpd_query_key_value(query, "node", value, sizeof(value)) == ESP_OK) node = atoi(value);
+        if (httpd_query_key_value(query, "n", value, sizeof(value)) == ESP_OK) count = atoi(value);
+        if (httpd_query_key_value(query, "field", value, sizeof(value)) == ESP_OK) {
+            for (field = 0; field < HISTORY_FIELD_COUNT && strcmp(value, history_field_names[field]) != 0; field++) {}
+        }
+    }
+    if (node < 0 || node >= (int)CAN_NODE_COUNT || field >= HISTORY_FIELD_COUNT) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "unknown node or field");
+    }
+    if (count <= 0 || count > LOCAL_API_HISTORY_MAX) count = LOCAL_API_HISTORY_MAX;
+
+    size_t max = 96 + (size_t)count * 8;
+    int32_t *values = malloc(sizeof(int32_t) * count);
+    char *body = malloc(max);
+    if (values == NULL || body == NULL) {
+        free(values);
+        free(body);
+        return httpd_resp_send_500(req);
+    }
+    size_t found = sensor_history_latest((uint8_t)node, field, values, count);
+    size_t len = (size_t)snprintf(body, max, "{\"node\": %d, \"field\": \"%s\", \"stored\": %u, \"values\": [",
+                                  node, history_field_names[field], (unsigned)sensor_history_count());
+    for (size_t i = 0; i < found && len < max; i++) len += (size_t)snprintf(body + len, max - len, "%s%d", (i > 0) ? ", " : "", (int)values[i]);
+    if (len < max) len += (size_t)snprintf(body + len, max - len, "]}");
+
+    httpd_resp_set_type(req, "application/json");
+    esp_err_t err = httpd_resp_send(req, body, (len < max) ? (ssize_t)len : (ssize_t)max - 1);
+    free(values);
+    free(body);
+    return err;
+}
+
+static esp_err_t thresholds_handler(httpd_req_t *req) {
+    char body[LOCAL_API_BODY_MAX];
+    if (!write_allowed(req)) return httpd_resp_send_err(req, HTTPD_401_UNAUTHORIZED, "wrong or missing API key");
+    if (req->content_len == 0 || req->content_len > sizeof(body)) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "expected a JSON object of thresholds");
+    }
+    size_t got = 0;
+    while (got < req->content_len) {
+        int n = httpd_req_recv(req, body + got, req->content_len - got);
+        if (n == HTTPD_SOCK_ERR_TIMEOUT) continue;
+        if (n <= 0) return ESP_FAIL; //connection gone, httpd closes it
+        got += (size_t)n;
+    }
+
+    if (apply_thresholds(body, got) <= 0) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "no known threshold in the body");
+    }
+    return state_handler(req); //answers with what is in effect now
+}
+
+static esp_err_t ws_handler(httpd_req_t *req) {
+    if (req->method == HTTP_GET) { //the handshake, sensor frames follow from broadcast_work
+        if (write_allowed(req)) {
+            req->sess_ctx = &ws_writer; //kept for the frames this socket sends later
+            req->free_ctx = no_free;
+        }
+        atomic_fetch_add(&ws_clients, 1);
+        return ESP_OK;
+    }
+
+    char payload[LOCAL_API_BODY_MAX];
+    httpd_ws_frame_t frame = { .type = HTTPD_WS_TYPE_TEXT };
+    esp_err_t err = httpd_ws_recv_frame(req, &frame, 0); //length only
+    if (err != ESP_OK) return err;
+    if (frame.len > sizeof(payload)) return ESP_FAIL; //nobody sends thresholds that long, drop the client
+    frame.payload = (uint8_t *)payload;
+    if (frame.len > 0 && (err = httpd_ws_recv_frame(req, &frame, frame.len)) != ESP_OK) return err;
+    if (frame.type != HTTPD_WS_TYPE_TEXT) return ESP_OK; //pings and pongs are answered by httpd
+
+    char reply[48];
+    size_t reply_len;
+    if (req->sess_ctx != &ws_writer) reply_len = (size_t)snprintf(reply, sizeof(reply), "{\"error\": \"read only, reconnect with ?key=\"}");
+    else reply_len = (size_t)snprintf(reply, sizeof(reply), "{\"applied\": %d}", apply_thresholds(payload, frame.len)); //-1 for bad JSON
+    httpd_ws_frame_t ack = { .type = HTTPD_WS_TYPE_TEXT, .payload = (uint8_t *)reply, .len = reply_len, .final = true };
+    return httpd_ws_send_frame(req, &ack);
+}
+
+static void broadcast_work(void *arg) { //httpd task, so it runs between requests and never races a handler
+    WsMessage *msg = (WsMessage *)arg;
+    int fds[LOCAL_API_MAX_CLIENTS];
+    size_t count = LOCAL_API_MAX_CLIENTS;
+    int sent = 0;
+
+    if (httpd_get_client_list(server, &count, fds) == ESP_OK) {
+        httpd_ws_frame_t frame = { .type = HTTPD_WS_TYPE_TEXT, .payload = (uint8_t *)msg->text, .len = msg->len, .final = true };
+        for (size_t i = 0; i < count; i++) {
+            if (httpd_ws_get_fd_info(server, fds[i]) != HTTPD_WS_CLIENT_WEBSOCKET) continue; //plain HTTP keep-alive sockets
+            if (httpd_ws_send_frame_async(server, fds[i], &frame) == ESP_OK) sent++;
+        }
+    }
+    atomic_store(&ws_clients, sent); //0 turns publishing off until the next handshake
+    free(msg);
+}
+
+void local_api_publish_sensor(const SensorData *data) {
+    if (server == NULL || atomic_load(&ws_clients) == 0) return;
+    WsMessage *msg = malloc(sizeof(WsMessage));
+    if (msg == NULL) return;
+    msg->len = format_sensor(data, msg->text, sizeof(msg->text));
+    if (httpd_queue_work(server, broadcast_work, msg) != ESP_OK) free(msg); //httpd busy, this frame is skipped
+}
+
+bool local_api_start(local_api_thresholds_cb_t on_thresholds) {
+    thresholds_cb = on_thresholds;
+
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.server_port = LOCAL_API_PORT;
+    config.max_open_sockets = LOCAL_API_MAX_CLIENTS;
+    config.lru_purge_enable = true; //a dashboard that vanished without closing makes room for a new one
+#if !CONFIG_FREERTOS_UNICORE
+    config.core_id = 0; //with the other network tasks, core 1 stays with control
+#endif
+    if (httpd_start(&server, &config) != ESP_OK) {
+        server = NULL;
+        return false;
+    }
+
+    const httpd_uri_t routes[] = {
+        { .uri = "/api/state", .method = HTTP_GET, .handler = state_handler },
+        { .uri = "/api/history", .method = HTTP_GET, .handler = history_handler },
+        { .uri = "/api/thresholds", .method = HTTP_POST, .handler = thresholds_handler },
+        { .uri = "/ws", .method = HTTP_GET, .handler = ws_handler, .is_websocket = true },
+    };
+    for (size_t i = 0; i < sizeof(routes) / sizeof(routes[0]); i++) {
+        httpd_register_uri_handler(server, &routes[i]);
+    }
+    printf("local API listening on port %d\n", LOCAL_API_PORT);
+#ifndef LOCAL_API_KEY
+    printf("local API is read-only, define LOCAL_API_KEY in secrets.h to allow threshold writes\n");
+#endif
+    return true;
+}
@@ -0,0 +1,24 @@
+#ifndef LOCAL_API_H
+#define LOCAL_API_H
+
+#include <stdbool.h>
+#include "plant_types.h"
+
+//LAN API on esp_http_server, for dashboards next to the rack that can't wait on the cloud round trip.
+//  GET  /api/state       latest reading of every zone's node with its last minute/hour min/max/mean, and the
+//                        thresholds in use, as JSON
+//  GET  /api/history     ?node=0&field=moisture&n=60, the newest raw values of one field from the history ring
+//  POST /api/thresholds  {"moisture": 450, "light-hours": 12, ...} with the adafruit feed keys, any subset
+//  GET  /ws              websocket, every decoded sensor frame is pushed as JSON text, threshold
+//                        objects written to it are applied like the POST
+//"water-now": 1 waters every zone once, like the cloud button.
+//writes need LOCAL_API_KEY from secrets.h in an X-API-Key header or a ?key= query (/ws?key=...), without one
+//defined the API is read-only. reads stay open to the LAN.
+
+//called from the httpd task with the merged thresholds, feeds has a bit per threshold_feed_keys entry the write set
+typedef void (*local_api_thresholds_cb_t)(const ThresholdData *thresh, uint8_t feeds);
+
+bool local_api_start(local_api_thresholds_cb_t on_thresholds); //after wifi_init, serves on every interface
+void local_api_publish_sensor(const SensorData *data); //from the control loop, never blocks, no-op without websocket clients
+
+#endif
@@ -0,0 +1,269 @@
+#include "ota_update.h"
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_ota_ops.h"
+#include "esp_app_desc.h"
+#include "esp_app_format.h"
+#include "esp_delta_ota.h"
+#include "esp_http_client.h"
+#include "esp_crt_bundle.h"
+#include "esp_partition.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "constants.h"
+#include "ada_transport.h"
+#include "pump_driver.h"
+#include "wifi_link.h"
+#include "perf_stats.h"
+#include "secrets.h"
+
+#define OTA_NVS_NAMESPACE "ota"
+#define OTA_NVS_KEY_ETAG "etag"
+#ifdef OTA_URL
+#define OTA_HAVE_URL 1
+#else
+#define OTA_HAVE_URL 0 //the task only confirms trial images
+#define OTA_URL ""
+#endif
+
+typedef struct {
+    const esp_partition_t *running; //delta patches are applied against it
+    const esp_partition_t *target;
+    esp_ota_handle_t ota;
+    esp_delta_ota_handle_t delta; //NULL for a full image
+    bool begun; //esp_ota_begin succeeded, the pumps are inhibited
+    size_t received;
+} OtaSession;
+
+static OtaSession session; //only touched by the ota task
+static TaskHandle_t ota_task_handle = NULL;
+static esp_timer_handle_t rollback_timer;
+static bool on_trial = false; //running image is pending verify
+static char last_etag[64]; //ETag of the image installed or last rejected, so it isn't downloaded again
+static char response_etag[64]; //ETag of the download in progress, written by its event handler
+
+static void etag_load(void) {
+    nvs_handle_t handle;
+    if (nvs_open(OTA_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) return;
+    size_t len = sizeof(last_etag);
+    if (nvs_get_str(handle, OTA_NVS_KEY_ETAG, last_etag, &len) != ESP_OK) last_etag[0] = '\0';
+    nvs_close(handle);
+}
+
+static void etag_store(void) {
+    nvs_handle_t handle;
+    if (nvs_open(OTA_NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) return;
+    if (nvs_set_str(handle, OTA_NVS_KEY_ETAG, last_etag) == ESP_OK) nvs_commit(handle);
+    nvs_close(handle);
+}
+
+static void rollback_timer_cb(void *arg) {
+    printf(" OTA UPDATE: new firmware did not come up healthy, rolling back\n");
+    pump_driver_inhibit(true); //outputs low without gpio_hold, so the pumps still work if there is nothing to roll back to
+    esp_ota_mark_app_invalid_rollback_and_reboot(); //only returns if there is no previous image to go back to
+    pump_driver_inhibit(false);
+}
+
+void ota_update_boot_check(void) {
+    esp_ota_img_states_t state;
+    if (esp_ota_get_state_partition(esp_ota_get_running_partition(), &state) != ESP_OK || state != ESP_OTA_IMG_PENDING_VERIFY) return;
+
+    on_trial = true;
+    esp_timer_create_args_t args = { .callback = rollback_timer_cb, .dispatch_method = ESP_TIMER_TASK, .name = "ota_rollback" };
+    if (esp_timer_create(&args, &rollback_timer) == ESP_OK) esp_timer_start_once(rollback_timer, OTA_VALIDATE_TIMEOUT_MS * 1000ULL);
+    printf("new firmware on trial, rolled back unless healthy within %d s\n", OTA_VALIDATE_TIMEOUT_MS / 1000);
+}
+
+void ota_update_init(void) {
+    etag_load();
+}
+
+static bool trial_passed(void) {
+    return wifi_link_is_up() && (!OTA_VALIDATE_NEED_CAN || perf_get_counter(PERF_CAN_RX) > 0); //the control loop is getting frames
+}
+
+static esp_err_t delta_read_base(uint8_t *buf, size_t size, int src_offset) {
+    return esp_partition_read(session.running, src_offset, buf, size);
+}
+
+static esp_err_t delta_write_image(const uint8_t *buf, size_t size) {
+    return esp_ota_write(session.ota, buf, size);
+}
+
+static bool session_begin(uint8_t first_byte) {
+    session.target = esp_ota_get_next_update_partition(NULL);
+    if (session.target == NULL) return false;
+
+    pump_driver_inhibit(true); //no watering while flash is rewritten, through to the restart
+    if (esp_ota_begin(session.target, OTA_WITH_SEQUENTIAL_WRITES, &session.ota) != ESP_OK) { //erases as it goes, no long stall up front
+        pump_driver_inhibit(false);
+        return false;
+    }
+    session.begun = true;
+
+    if (first_byte != ESP_IMAGE_HEADER_MAGIC) { //anything but an app image header is a compressed patch against the running image
+        esp_delta_ota_cfg_t cfg = { .read_cb = delta_read_base, .write_cb = delta_write_image };
+        session.delta = esp_delta_ota_init(&cfg);
+        if (session.delta == NULL) return false;
+    }
+    printf(" OTA UPDATE: writing %s image to %s\n", (session.delta != NULL) ? "delta" : "full", session.target->label);
+    return true;
+}
+
+static bool ota_sink(const uint8_t *data, size_t len) {
+    if (!session.begun && !session_begin(data[0])) return false;
+    session.received += len;
+    if (session.delta != NULL) return esp_delta_ota_feed_patch(session.delta, data, (int)len) == ESP_OK;
+    return esp_ota_write(session.ota, data, len) == ESP_OK;
+}
+
+static void session_abort(void) {
+    if (session.delta != NULL) esp_delta_ota_deinit(session.delta);
+    if (session.begun) {
+        esp_ota_abort(session.ota);
+        pump_driver_inhibit(false);
+    }
+    session.delta = NULL;
+    session.begun = false;
+}
+
+static esp_err_t session_finish(void) {
+    esp_err_t err = ESP_OK;
+    if (session.delta != NULL) {
+        err = esp_delta_ota_finalize(session.delta); //flushes the last of the patched image into esp_ota_write
+        esp_delta_ota_deinit(session.delta);
+        session.delta = NULL;
+    }
+    if (err != ESP_OK) return err; //session_abort still owns the ota handle
+
+    session.begun = false; //esp_ota_end releases the handle whatever it returns
+    err = esp_ota_end(session.ota); //checks the image hash, and the signature with secure boot
+    if (err == ESP_OK) {
+        esp_app_desc_t next;
+        if (esp_ota_get_partition_description(session.target, &next) == ESP_OK &&
+            memcmp(next.app_elf_sha256, esp_app_get_description()->app_elf_sha256, sizeof(next.app_elf_sha256)) == 0) {
+            err = ESP_ERR_INVALID_VERSION; //same build as running, not worth a restart
+        }
+    }
+    if (err == ESP_OK) err = esp_ota_set_boot_partition(session.target);
+    if (err != ESP_OK) pump_driver_inhibit(false);
+    return err;
+}
+
+static esp_err_t download_event_handler(esp_http_client_event_t *evt) {
+    if (evt->event_id == HTTP_EVENT_ON_HEADER && strcasecmp(evt->header_key, "ETag") == 0) {
+        strlcpy(response_etag, evt->header_value, sizeof(response_etag));
+    }
+    return ESP_OK;
+}
+
+//a client of its own for each check: the adafruit session is never held for the minutes a download can take on
+//weak wifi, and OTA_URL is verified against the CA bundle even when adafruit uses the pinned CA (ada_tls.h)
+static PullResult download(const char *url, const char *const *headers) {
+    esp_http_client_config_t config = {
+        .url = url,
+        .method = HTTP_METHOD_GET,
+        .event_handler = download_event_handler,
+        .crt_bundle_attach = esp_crt_bundle_attach,
+    };
+    response_etag[0] = '\0';
+    esp_http_client_handle_t client = esp_http_client_init(&config);
+    if (client == NULL) return PULL_FAILED;
+    if (last_etag[0] != '\0') esp_http_client_set_header(client, "If-None-Match", last_etag);
+    for (const char *const *h = headers; h[0] != NULL; h += 2) esp_http_client_set_header(client, h[0], h[1]);
+
+    PullResult result = PULL_FAILED;
+    if (esp_http_client_open(client, 0) == ESP_OK && esp_http_client_fetch_headers(client) >= 0) {
+        int status = esp_http_client_get_status_code(client);
+        if (status == 304) {
+            result = PULL_UNCHANGED;
+        } else if (status == 200) {
+            static char chunk[1024]; //only the ota task downloads
+            int read_len;
+            bool accepted = true;
+            while ((read_len = esp_http_client_read(client, chunk, sizeof(chunk))) > 0) {
+                if (!(accepted = ota_sink((const uint8_t *)chunk, read_len))) break;
+            }
+            if (read_len == 0 && accepted && esp_http_client_is_complete_data_received(client)) result = PULL_UPDATED;
+        } else {
+            printf(" OTA UPDATE: server answered %d\n", status);
+        }
+    }
+    esp_http_client_cleanup(client);
+    return result;
+}
+
+static void check_for_update(void) {
+    char elf_sha[65];
+    esp_app_get_elf_sha256(elf_sha, sizeof(elf_sha));
+    const char *const headers[] = { //lets the server send a patch made against this exact build, or the full image
+        "X-Firmware-Version", esp_app_get_description()->version,
+        "X-Firmware-Sha256", elf_sha,
+#ifdef OTA_KEY
+        "X-OTA-Key", OTA_KEY,
+#endif
+        NULL,
+    };
+
+    memset(&session, 0, sizeof(session));
+    session.running = esp_ota_get_running_partition();
+    int64_t start = esp_timer_get_time();
+    PullResult result = download(OTA_URL, headers);
+    if (result == PULL_UNCHANGED) return;
+
+    esp_err_t err = ESP_ERR_INVALID_SIZE; //a 200 without a body
+    if (result == PULL_FAILED) err = ESP_FAIL;
+    else if (session.begun) err = session_finish();
+    if (err != ESP_OK) {
+        session_abort();
+        printf(" OTA UPDATE: update failed after %u bytes (%s)\n", (unsigned)session.received, esp_err_to_name(err));
+        if (result == PULL_UPDATED) strlcpy(last_etag, response_etag, sizeof(last_etag)); //a rejected image is only tried again once it changes
+        return;
+    }
+
+    strlcpy(last_etag, response_etag, sizeof(last_etag));
+    etag_store();
+    printf(" OTA UPDATE: %u bytes in %u ms, restarting into %s\n", (unsigned)session.received,
+           (unsigned)((esp_timer_get_time() - start) / 1000), session.target->label);
+    pump_driver_hold_off(); //pins stay latched low through the reset until the new image's pump_driver_init
+    esp_restart();
+}
+
+void ota_task(void *pvParameters) {
+    ota_task_handle = xTaskGetCurrentTaskHandle();
+
+    while (on_trial) { //the rollback timer runs out unless this passes first
+        if (trial_passed()) {
+            esp_timer_stop(rollback_timer);
+            esp_ota_mark_app_valid_cancel_rollback();
+            on_trial = false;
+            printf(" OTA UPDATE: new firmware is healthy, keeping it\n");
+        } else {
+            vTaskDelay(pdMS_TO_TICKS(1000));
+        }
+    }
+
+    while (OTA_ENABLE && OTA_HAVE_URL) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(OTA_CHECK_INTERVAL_MS)); //interval or a console request, whichever comes first
+        if (wifi_link_is_up()) check_for_update();
+    }
+    ota_task_handle = NULL;
+    vTaskDelete(NULL); //nothing left to do without an update URL
+}
+
+bool ota_update_check_now(void) {
+    TaskHandle_t task = ota_task_handle;
+    if (task == NULL) return false;
+    xTaskNotifyGive(task);
+    return true;
+}
+
+void ota_update_print_status(void) {
+    const esp_partition_t *running = esp_ota_get_running_partition();
+    const esp_app_desc_t *desc = esp_app_get_description();
+    printf("running %s from %s%s, last image etag '%s'\n", desc->version, running->label, on_trial ? " (on trial)" : "", last_etag);
+}
@@ -0,0 +1,18 @@
+#ifndef OTA_UPDATE_H
+#define OTA_UPDATE_H
+
+#include <stdbool.h>
+
+//firmware updates over https. the ota task polls OTA_URL (secrets.h) with a client of its own,
+//sending the running build's version and ELF hash so the server can answer 304, a delta patch against this exact
+//build or a full image. the pumps are held off from the first byte written until the new image runs.
+//a freshly updated image is on trial: unless wifi and the CAN bus come up within OTA_VALIDATE_TIMEOUT_MS, the
+//bootloader is told to go back to the previous one.
+
+void ota_update_boot_check(void); //early in app_main, arms the rollback timer when this boot is a trial
+void ota_update_init(void); //after NVS init
+void ota_task(void *pvParameters);
+bool ota_update_check_now(void); //poll right away instead of at the next interval, false if the task isn't running
+void ota_update_print_status(void);
+
+#endif
@@ -0,0 +1,157 @@
+#include "perf_stats.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include "driver/twai.h"
+#include "esp_system.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "power_mgmt.h"
+
+static const char *const latency_names[PERF_LAT_COUNT] = { "publish", "pull", "connect", "http_lock", "control" };
+static const char *const counter_names[PERF_COUNTER_COUNT] = { "can_rx", "can_dropped", "can_filtered", "can_lost", "can_bus_off", "can_rx_overflow", "upload_ok", "upload_offline", "wifi_disconnect", "upload_held", "sensor_outliers" };
+
+static portMUX_TYPE perf_lock = portMUX_INITIALIZER_UNLOCKED;
+static PerfHistogram histograms[PERF_LAT_COUNT];
+static uint32_t counters[PERF_COUNTER_COUNT];
+static TaskHandle_t tasks[PERF_MAX_TASKS];
+static int task_count = 0;
+
+void perf_record_latency(PerfLatency which, int64_t us) {
+    if (which >= PERF_LAT_COUNT) return;
+    if (us < 0) us = 0;
+    uint32_t value = (us > UINT32_MAX) ? UINT32_MAX : (uint32_t)us;
+
+    int bucket = (value == 0) ? 0 : 32 - __builtin_clz(value); //bucket b holds [2^(b-1), 2^b)
+    if (bucket >= PERF_HIST_BUCKETS) bucket = PERF_HIST_BUCKETS - 1;
+
+    portENTER_CRITICAL(&perf_lock);
+    PerfHistogram *hist = &histograms[which];
+    hist->count++;
+    hist->sum_us += value;
+    if (value > hist->max_us) hist->max_us = value;
+    hist->buckets[bucket]++;
+    portEXIT_CRITICAL(&perf_lock);
+}
+
+void perf_count(PerfCounter which, uint32_t n) {
+    if (which >= PERF_COUNTER_COUNT) return;
+    portENTER_CRITICAL(&perf_lock);
+    counters[which] += n;
+    portEXIT_CRITICAL(&perf_lock);
+}
+
+void perf_register_task(TaskHandle_t task) {
+    portENTER_CRITICAL(&perf_lock);
+    if (task != NULL && task_count < PERF_MAX_TASKS) tasks[task_count++] = task;
+    portEXIT_CRITICAL(&perf_lock);
+}
+
+void perf_get_histogram(PerfLatency which, PerfHistogram *out) {
+    portENTER_CRITICAL(&perf_lock);
+    *out = histograms[which];
+    portEXIT_CRITICAL(&perf_lock);
+}
+
+uint32_t perf_get_counter(PerfCounter which) {
+    portENTER_CRITICAL(&perf_lock);
+    uint32_t value = counters[which];
+    portEXIT_CRITICAL(&perf_lock);
+    return value;
+}
+
+uint32_t perf_histogram_percentile(const PerfHistogram *hist, int percent) {
+    if (hist->count == 0) return 0;
+    uint32_t target = (uint32_t)(((uint64_t)hist->count * percent + 99) / 100);
+    uint32_t seen = 0;
+    for (int b = 0; b < PERF_HIST_BUCKETS; b++) {
+        seen += hist->buckets[b];
+        if (seen >= target) {
+            uint32_t upper = (b == 0) ? 0 : (1u << b) - 1;
+            return (upper < hist->max_us) ? upper : hist->max_us; //never claim more than was seen
+        }
+    }
+    return hist->max_us;
+}
+
+static size_t append(char *buf, size_t len, size_t pos, const char *fmt, ...) __attribute__((format(printf, 4, 5)));
+static size_t append(char *buf, size_t len, size_t pos, const char *fmt, ...) {
+    if (pos >= len) return pos;
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(buf + pos, len - pos, fmt, args);
+    va_end(args);
+    return (n < 0) ? pos : pos + n;
+}
+
+size_t perf_format_report(char *buf, size_t len) {
+    size_t pos = 0;
+    pos = append(buf, len, pos, "uptime %llds, heap free %u min %u largest %u\n",
+                 esp_timer_get_time() / 1000000, (unsigned)esp_get_free_heap_size(), (unsigned)esp_get_minimum_free_heap_size(),
+                 (unsigned)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+
+    for (int i = 0; i < PERF_LAT_COUNT; i++) {
+        PerfHistogram hist;
+        perf_get_histogram(i, &hist);
+        pos = append(buf, len, pos, "%-10s n=%u avg=%lluus p50<=%uus p95<=%uus max=%uus\n", latency_names[i], (unsigned)hist.count,
+                     hist.count ? hist.sum_us / hist.count : 0, (unsigned)perf_histogram_percentile(&hist, 50),
+                     (unsigned)perf_histogram_percentile(&hist, 95), (unsigned)hist.max_us);
+    }
+
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        pos = append(buf, len, pos, "%s=%u%s", counter_names[i], (unsigned)perf_get_counter(i), (i == PERF_COUNTER_COUNT - 1) ? "\n" : " ");
+    }
+
+    twai_status_info_t twai;
+    if (twai_get_status_info(&twai) == ESP_OK) { //driver counters, reset whenever low-power mode reinstalls it
+        pos = append(buf, len, pos, "twai state=%d rx_missed=%u rx_overrun=%u bus_errors=%u arb_lost=%u\n", twai.state,
+                     (unsigned)twai.rx_missed_count, (unsigned)twai.rx_overrun_count, (unsigned)twai.bus_error_count,
+                     (unsigned)twai.arb_lost_count);
+    }
+
+    int count = task_count;
+    for (int i = 0; i < count; i++) {
+        pos = append(buf, len, pos, "task %-12s stack free %u bytes\n", pcTaskGetName(tasks[i]),
+                     (unsigned)(uxTaskGetStackHighWaterMark(tasks[i]) * sizeof(StackType_t)));
+    }
+
+    PowerStats power;
+    power_get_stats(&power);
+    if (power_low_power_enabled()) {
+        pos = append(buf, len, pos, "power asleep=%llus awake=%llus %.1fuAh/sample\n", power.asleep_us / 1000000,
+                     power.awake_us / 1000000, power.charge_uah_per_sample);
+    }
+    return pos;
+}
+
+size_t perf_format_compact(char *buf, size_t len) {
+    size_t pos = 0;
+    pos = append(buf, len, pos, "up=%lld heap=%u minheap=%u", esp_timer_get_time() / 1000000,
+                 (unsigned)esp_get_free_heap_size(), (unsigned)esp_get_minimum_free_heap_size());
+
+    for (int i = 0; i < PERF_LAT_COUNT; i++) {
+        PerfHistogram hist;
+        perf_get_histogram(i, &hist);
+        if (hist.count == 0) continue;
+        pos = append(buf, len, pos, " %s_p95=%u %s_max=%u", latency_names[i], (unsigned)perf_histogram_percentile(&hist, 95),
+                     latency_names[i], (unsigned)hist.max_us);
+    }
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        pos = append(buf, len, pos, " %s=%u", counter_names[i], (unsigned)perf_get_counter(i));
+    }
+
+    int count = task_count;
+    uint32_t min_stack = UINT32_MAX;
+    for (int i = 0; i < count; i++) {
+        uint32_t free_bytes = uxTaskGetStackHighWaterMark(tasks[i]) * sizeof(StackType_t);
+        if (free_bytes < min_stack) min_stack = free_bytes;
+    }
+    if (count > 0) pos = append(buf, len, pos, " min_stack=%u", (unsigned)min_stack);
+
+    if (power_low_power_enabled()) {
+        PowerStats power;
+        power_get_stats(&power);
+        pos = append(buf, len, pos, " uah_sample=%.1f", power.charge_uah_per_sample);
+    }
+    return pos;
+}
@@ -0,0 +1,59 @@
+#ifndef PERF_STATS_H
+#define PERF_STATS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+//runtime instrumentation: latency histograms, event counters, task stack and heap watermarks.
+//cheap enough to record from any task (one spinlock section per call), read out by the
+//console "stats" command and the optional diagnostics feed.
+
+typedef enum {
+    PERF_LAT_PUBLISH, //one upload call to the transport
+    PERF_LAT_PULL, //one threshold download
+    PERF_LAT_CONNECT, //TCP + TLS handshake of a new connection
+    PERF_LAT_HTTP_LOCK, //wait for the shared http session
+    PERF_LAT_CONTROL, //control loop, frame dequeued -> actuators updated
+    PERF_LAT_COUNT
+} PerfLatency;
+
+typedef enum {
+    PERF_CAN_RX, //frames decoded and queued
+    PERF_CAN_DROPPED, //control queue full
+    PERF_CAN_FILTERED, //unknown ID or malformed frame that got past the acceptance filter
+    PERF_CAN_LOST, //v2 messages missing from a node's sequence
+    PERF_CAN_BUS_OFF, //bus-off events, each one followed by a recovery
+    PERF_CAN_RX_OVERFLOW, //driver RX queue or controller FIFO overran
+    PERF_UPLOAD_OK, //samples delivered
+    PERF_UPLOAD_OFFLINE, //samples moved to the flash log
+    PERF_WIFI_DISCONNECT, //station disconnects and failed joins
+    PERF_UPLOAD_HELD, //feed values not sent, inside their deadband or over the rate budget
+    PERF_SENSOR_OUTLIER, //field readings the sensor filter held back as spikes
+    PERF_COUNTER_COUNT
+} PerfCounter;
+
+#define PERF_HIST_BUCKETS 25 //log2 buckets of microseconds, the last one is 2^23 us (8 s) and up
+#define PERF_MAX_TASKS 8
+
+typedef struct {
+    uint32_t count;
+    uint32_t max_us;
+    uint64_t sum_us;
+    uint32_t buckets[PERF_HIST_BUCKETS];
+} PerfHistogram;
+
+void perf_record_latency(PerfLatency which, int64_t us);
+void perf_count(PerfCounter which, uint32_t n);
+void perf_register_task(TaskHandle_t task); //stack high-water marks are reported for these
+
+void perf_get_histogram(PerfLatency which, PerfHistogram *out);
+uint32_t perf_get_counter(PerfCounter which);
+uint32_t perf_histogram_percentile(const PerfHistogram *hist, int percent); //upper bucket bound in us
+
+size_t perf_format_report(char *buf, size_t len); //multi-line, for the console
+size_t perf_format_compact(char *buf, size_t len); //one line of key=value, for the diagnostics feed
+
+#endif
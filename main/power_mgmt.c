@@ -0,0 +1,133 @@
+#include "power_mgmt.h"
+#include <stdio.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "driver/gpio.h"
+#include "esp_attr.h"
+#include "esp_pm.h"
+#include "esp_sleep.h"
+#include "esp_timer.h"
+#include "constants.h"
+
+static SemaphoreHandle_t can_wake_sem;
+static void (*water_cb)(void) = NULL;
+
+static portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint64_t asleep_us = 0; //written from the light sleep exit callback
+static PowerStats last_report;
+
+static void can_rx_isr(void *arg) {
+    gpio_intr_disable(CAN_RX_PIN); //level triggered, would fire again until TWAI takes the pin back
+    BaseType_t woken = pdFALSE;
+    xSemaphoreGiveFromISR(can_wake_sem, &woken);
+    if (woken) portYIELD_FROM_ISR();
+}
+
+static void water_isr(void *arg) {
+    if (power_low_power_enabled()) gpio_intr_disable(WATER_LEVEL_PIN); //level triggered, re-armed for the other level by power_arm_water_wakeup()
+    if (water_cb != NULL) water_cb();
+}
+
+#if CONFIG_PM_LIGHT_SLEEP_CALLBACKS
+static esp_err_t IRAM_ATTR on_sleep_exit(int64_t slept_us, void *arg) {
+    portENTER_CRITICAL_ISR(&stats_lock);
+    asleep_us += slept_us;
+    portEXIT_CRITICAL_ISR(&stats_lock);
+    return ESP_OK;
+}
+#endif
+
+bool power_low_power_enabled(void) {
+#if POWER_LOW_POWER_MODE && CONFIG_PM_ENABLE
+    return true;
+#else
+    return false;
+#endif
+}
+
+void power_mgmt_init(void (*water_change_isr)(void)) {
+    water_cb = water_change_isr;
+    gpio_install_isr_service(0);
+    if (!power_low_power_enabled()) { //no wakeups to arm, but the float switch still cuts the pumps the moment it drops
+        gpio_set_intr_type(WATER_LEVEL_PIN, GPIO_INTR_ANYEDGE);
+        gpio_isr_handler_add(WATER_LEVEL_PIN, water_isr, NULL);
+        gpio_intr_enable(WATER_LEVEL_PIN);
+        return;
+    }
+
+#if CONFIG_PM_ENABLE
+    esp_pm_config_t pm_config = {
+        .max_freq_mhz = POWER_MAX_FREQ_MHZ,
+        .min_freq_mhz = POWER_MIN_FREQ_MHZ,
+        .light_sleep_enable = true, //tickless idle sleeps whenever no pm lock is held
+    };
+    ESP_ERROR_CHECK(esp_pm_configure(&pm_config));
+#endif
+
+#if CONFIG_PM_LIGHT_SLEEP_CALLBACKS
+    esp_pm_sleep_cbs_register_config_t cbs = { .exit_cb = on_sleep_exit };
+    esp_pm_light_sleep_register_cbs(&cbs);
+#endif
+
+    can_wake_sem = xSemaphoreCreateBinary();
+    gpio_isr_handler_add(CAN_RX_PIN, can_rx_isr, NULL);
+    gpio_isr_handler_add(WATER_LEVEL_PIN, water_isr, NULL);
+    ESP_ERROR_CHECK(esp_sleep_enable_gpio_wakeup());
+
+    power_arm_water_wakeup(gpio_get_level(WATER_LEVEL_PIN) == 1);
+    printf("low power mode on, light sleep between %d and %d MHz\n", POWER_MIN_FREQ_MHZ, POWER_MAX_FREQ_MHZ);
+}
+
+void power_wait_can_activity(void) {
+    //the frame that wakes us is lost: TWAI isn't installed to receive it, and on a bus with more than one pod
+    //another one ACKs it so it is never retransmitted. the caller sends a resend request once TWAI is back
+    gpio_set_direction(CAN_RX_PIN, GPIO_MODE_INPUT);
+    gpio_wakeup_enable(CAN_RX_PIN, GPIO_INTR_LOW_LEVEL); //recessive is high, a start of frame pulls it low
+    gpio_intr_enable(CAN_RX_PIN);
+
+    xSemaphoreTake(can_wake_sem, portMAX_DELAY);
+    gpio_wakeup_disable(CAN_RX_PIN);
+}
+
+void power_arm_water_wakeup(bool water_level) {
+    if (!power_low_power_enabled()) return;
+    gpio_wakeup_enable(WATER_LEVEL_PIN, water_level ? GPIO_INTR_LOW_LEVEL : GPIO_INTR_HIGH_LEVEL);
+    gpio_intr_enable(WATER_LEVEL_PIN);
+}
+
+void power_get_stats(PowerStats *out) {
+    portENTER_CRITICAL(&stats_lock);
+    *out = last_report;
+    out->asleep_us = asleep_us;
+    portEXIT_CRITICAL(&stats_lock);
+    uint64_t uptime = esp_timer_get_time();
+    out->awake_us = (uptime > out->asleep_us) ? uptime - out->asleep_us : 0;
+}
+
+void power_sample_tick(void) {
+    static uint64_t prev_asleep = 0;
+    static int64_t prev_time = 0;
+
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&stats_lock);
+    uint64_t slept = asleep_us;
+    portEXIT_CRITICAL(&stats_lock);
+
+    if (prev_time != 0) { //charge model: awake and asleep currents from constants.h, weighted by residency
+        uint64_t interval = now - prev_time;
+        uint64_t sleep_part = slept - prev_asleep;
+        if (sleep_part > interval) sleep_part = interval;
+        float charge_uah = ((interval - sleep_part) * (float)POWER_AWAKE_UA + sleep_part * (float)POWER_ASLEEP_UA) / 3.6e9f;
+
+        portENTER_CRITICAL(&stats_lock);
+        last_report.charge_uah_per_sample = charge_uah;
+        last_report.samples++;
+        portEXIT_CRITICAL(&stats_lock);
+
+        if (power_low_power_enabled() && last_report.samples % POWER_REPORT_SAMPLES == 0) {
+            printf(" POWER: %.1f uAh per sample, asleep %u%% of the last interval\n", charge_uah, (unsigned)(sleep_part * 100 / interval));
+        }
+    }
+    prev_asleep = slept;
+    prev_time = now;
+}
@@ -0,0 +1,27 @@
+#ifndef POWER_MGMT_H
+#define POWER_MGMT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//low-power mode for battery/solar beds (POWER_LOW_POWER_MODE). the chip light-sleeps whenever every
+//task is blocked, the radio sleeps between DTIM beacons, and GPIO wakeups on the CAN RX and
+//water-level pins keep frames and float switch changes serviced.
+
+typedef struct {
+    uint64_t asleep_us; //total light sleep since boot
+    uint64_t awake_us;
+    uint32_t samples; //primary node samples counted so far
+    float charge_uah_per_sample; //estimated charge drawn between the last two reported samples
+} PowerStats;
+
+void power_mgmt_init(void (*water_change_isr)(void)); //callback runs in ISR context when the float switch flips
+bool power_low_power_enabled(void);
+
+void power_wait_can_activity(void); //blocks until the CAN RX line goes dominant, TWAI must be uninstalled. that frame is lost
+void power_arm_water_wakeup(bool water_level); //re-arm for the opposite level after every change
+
+void power_sample_tick(void); //once per primary node sample, updates the per-sample charge estimate
+void power_get_stats(PowerStats *out);
+
+#endif
@@ -0,0 +1,213 @@
+#include "pump_driver.h"
+#include <stdio.h>
+#include <stdatomic.h>
+#include "driver/gpio.h"
+#include "driver/gptimer.h"
+#include "driver/ledc.h"
+#include "esp_rom_gpio.h"
+#include "soc/gpio_sig_map.h"
+#include "esp_pm.h"
+#include "nvs.h"
+#include "constants.h"
+#include "plant_control.h"
+#include "light_output.h"
+#include "tunables.h"
+
+#define PUMP_NVS_NAMESPACE "pump"
+#define PUMP_LEDC_TIMER LEDC_TIMER_1 //the lights have LEDC_TIMER_0
+#define PUMP_LEDC_CHANNEL(zone) (LEDC_CHANNEL_MAX - 1 - (zone)) //taken from the top, the lights count up from 0
+#define PUMP_DUTY_MAX ((1u << PUMP_PWM_BITS) - 1)
+
+typedef struct {
+    gptimer_handle_t timer; //NULL if none was free, the control loop deadline ends the run then
+    bool soft_start; //has an LEDC channel to ramp on
+    bool timer_enabled; //only touched by the control task, an enabled timer keeps the APB clock (and so light sleep) up
+    bool pm_held;
+} PumpSlot;
+
+static PumpSlot pumps[ZONE_COUNT];
+static atomic_uint flow_ul_s[ZONE_COUNT]; //calibrated flow, set from the console, read by the control task
+static atomic_bool inhibited = false; //firmware update running, no pump may start
+#if CONFIG_PM_ENABLE
+static esp_pm_lock_handle_t pump_pm_lock; //LEDC stops in light sleep, held while a soft-started pump runs
+#endif
+
+static void output_off(int zone) { //ISR safe, the timer alarm and the float switch both end up here
+    int pin = zone_config[zone].pump_gpio;
+    if (pumps[zone].soft_start) esp_rom_gpio_connect_out_signal(pin, SIG_GPIO_OUT_IDX, false, false); //take the pin back from LEDC mid-ramp
+    gpio_set_level(pin, 0);
+}
+
+static void output_on(int zone) {
+    int pin = zone_config[zone].pump_gpio;
+    if (!pumps[zone].soft_start) {
+        gpio_set_level(pin, 1);
+        return;
+    }
+    ledc_channel_config_t channel = { //re-attaches the pin to LEDC after the last cut
+        .speed_mode = LEDC_LOW_SPEED_MODE,
+        .channel = PUMP_LEDC_CHANNEL(zone),
+        .timer_sel = PUMP_LEDC_TIMER,
+        .intr_type = LEDC_INTR_DISABLE,
+        .gpio_num = pin,
+        .duty = 0,
+        .hpoint = 0,
+    };
+    ledc_channel_config(&channel);
+    ledc_set_fade_time_and_start(LEDC_LOW_SPEED_MODE, PUMP_LEDC_CHANNEL(zone), PUMP_DUTY_MAX, PUMP_SOFT_START_MS, LEDC_FADE_NO_WAIT);
+}
+
+static bool pump_alarm_cb(gptimer_handle_t timer, const gptimer_alarm_event_data_t *edata, void *user_ctx) { //ISR
+    gptimer_stop(timer);
+    output_off((int)(intptr_t)user_ctx);
+    return false; //no task woken, the control loop catches up at its own deadline
+}
+
+static void flow_key(int zone, char *key, size_t len) {
+    snprintf(key, len, "flow%d", zone);
+}
+
+static void cal_load(void) {
+    nvs_handle_t handle;
+    bool opened = nvs_open(PUMP_NVS_NAMESPACE, NVS_READONLY, &handle) == ESP_OK;
+    for (int z = 0; z < (int)ZONE_COUNT; z++) {
+        char key[16];
+        uint32_t flow = 0;
+        flow_key(z, key, sizeof(key));
+        if (!opened || nvs_get_u32(handle, key, &flow) != ESP_OK || flow == 0) flow = PUMP_FLOW_DEFAULT_UL_S;
+        atomic_store(&flow_ul_s[z], flow);
+    }
+    if (opened) nvs_close(handle);
+}
+
+void pump_driver_init(void) {
+    cal_load();
+
+    bool ledc_ok = false;
+    if (PUMP_SOFT_START_MS > 0) {
+        ledc_timer_config_t ledc_timer = {
+            .speed_mode = LEDC_LOW_SPEED_MODE,
+            .timer_num = PUMP_LEDC_TIMER,
+            .duty_resolution = PUMP_PWM_BITS,
+            .freq_hz = PUMP_PWM_FREQ_HZ,
+            .clk_cfg = LEDC_AUTO_CLK,
+        };
+        ledc_ok = ledc_timer_config(&ledc_timer) == ESP_OK;
+#if CONFIG_PM_ENABLE
+        esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "pump_pwm", &pump_pm_lock);
+#endif
+    }
+
+    for (int z = 0; z < (int)ZONE_COUNT; z++) {
+        int pin = zone_config[z].pump_gpio;
+        gpio_reset_pin(pin);
+        gpio_set_direction(pin, GPIO_MODE_OUTPUT);
+        gpio_set_level(pin, 0); //force voltage low
+        gpio_hold_dis(pin); //held low across the reset if an update just restarted the chip
+
+        pumps[z].soft_start = ledc_ok && PUMP_LEDC_CHANNEL(z) >= light_output_channel_count();
+        if (ledc_ok && !pumps[z].soft_start) printf("zone %d: no LEDC channel left, pump switches on without soft start\n", z);
+
+        gptimer_config_t timer_config = {
+            .clk_src = GPTIMER_CLK_SRC_DEFAULT,
+            .direction = GPTIMER_COUNT_UP,
+            .resolution_hz = 1000000, //1 us ticks, alarms are run times in us
+        };
+        gptimer_event_callbacks_t callbacks = { .on_alarm = pump_alarm_cb };
+        if (gptimer_new_timer(&timer_config, &pumps[z].timer) != ESP_OK) {
+            pumps[z].timer = NULL;
+            printf("zone %d: no hardware timer left, pump runs end on the control deadline\n", z);
+            continue;
+        }
+        gptimer_register_event_callbacks(pumps[z].timer, &callbacks, (void *)(intptr_t)z);
+    }
+}
+
+uint32_t pump_dose_run_us(int zone) {
+    if (zone < 0 || zone >= (int)ZONE_COUNT) return 0;
+    uint32_t flow = atomic_load(&flow_ul_s[zone]);
+    uint64_t run_us = (uint64_t)tunable_get(TUNE_PUMP_DOSE_ML) * 1000 * 1000000 / flow;
+    if (pumps[zone].soft_start) run_us += PUMP_SOFT_START_MS * 1000 / 2; //a linear ramp moves half the water a full-speed run would
+    if (run_us > PUMP_RUN_MAX_US) run_us = PUMP_RUN_MAX_US;
+    return (uint32_t)run_us;
+}
+
+bool pump_driver_start(int zone, uint32_t run_us) {
+    if (zone < 0 || zone >= (int)ZONE_COUNT) return false;
+    if (gpio_get_level(WATER_LEVEL_PIN) == 0 || atomic_load(&inhibited)) return false; //never start on an empty reservoir or mid-update
+    PumpSlot *pump = &pumps[zone];
+
+    if (pump->timer != NULL) {
+        if (!pump->timer_enabled) pump->timer_enabled = gptimer_enable(pump->timer) == ESP_OK;
+        gptimer_alarm_config_t alarm = { .alarm_count = run_us };
+        gptimer_set_raw_count(pump->timer, 0);
+        gptimer_set_alarm_action(pump->timer, &alarm);
+    }
+#if CONFIG_PM_ENABLE
+    if (pump->soft_start && !pump->pm_held && pump_pm_lock != NULL) {
+        esp_pm_lock_acquire(pump_pm_lock);
+        pump->pm_held = true;
+    }
+#endif
+
+    output_on(zone);
+    if (pump->timer_enabled) gptimer_start(pump->timer); //counts from the moment the output went on
+    if (gpio_get_level(WATER_LEVEL_PIN) == 0 || atomic_load(&inhibited)) output_off(zone); //the float switch dropped or an update began while this was being armed
+    return true;
+}
+
+void pump_driver_stop(int zone) {
+    if (zone < 0 || zone >= (int)ZONE_COUNT) return;
+    PumpSlot *pump = &pumps[zone];
+
+    if (pump->timer_enabled) {
+        gptimer_stop(pump->timer); //already stopped when the alarm ended the run, the error is harmless
+        gptimer_disable(pump->timer);
+        pump->timer_enabled = false;
+    }
+    if (pump->soft_start) ledc_fade_stop(LEDC_LOW_SPEED_MODE, PUMP_LEDC_CHANNEL(zone));
+    output_off(zone);
+#if CONFIG_PM_ENABLE
+    if (pump->pm_held) {
+        esp_pm_lock_release(pump_pm_lock);
+        pump->pm_held = false;
+    }
+#endif
+}
+
+void pump_driver_cut_all_from_isr(void) {
+    for (int z = 0; z < (int)ZONE_COUNT; z++) {
+        if (pumps[z].timer != NULL) gptimer_stop(pumps[z].timer); //allowed in ISR context, fails harmlessly when idle
+        output_off(z);
+    }
+}
+
+void pump_driver_inhibit(bool on) {
+    atomic_store(&inhibited, on);
+    if (on) pump_driver_cut_all_from_isr(); //the control loop still stops each run at its deadline and releases the timer
+}
+
+void pump_driver_hold_off(void) {
+    pump_driver_inhibit(true);
+    for (int z = 0; z < (int)ZONE_COUNT; z++) gpio_hold_en(zone_config[z].pump_gpio); //latched low through esp_restart until pump_driver_init lets go
+}
+
+uint32_t pump_cal_get(int zone) {
+    if (zone < 0 || zone >= (int)ZONE_COUNT) return 0;
+    return atomic_load(&flow_ul_s[zone]);
+}
+
+esp_err_t pump_cal_set(int zone, uint32_t ul_per_s) {
+    if (zone < 0 || zone >= (int)ZONE_COUNT || ul_per_s == 0) return ESP_ERR_INVALID_ARG;
+    atomic_store(&flow_ul_s[zone], ul_per_s); //the next run uses it, stored or not
+
+    char key[16];
+    flow_key(zone, key, sizeof(key));
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(PUMP_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err != ESP_OK) return err;
+    err = nvs_set_u32(handle, key, ul_per_s);
+    if (err == ESP_OK) err = nvs_commit(handle);
+    nvs_close(handle);
+    return err;
+}
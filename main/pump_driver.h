@@ -0,0 +1,25 @@
+#ifndef PUMP_DRIVER_H
+#define PUMP_DRIVER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+//pump outputs for every zone. a watering is a dose (the dose_ml tunable), turned into a run time from the zone's flow
+//calibration (kept in NVS) and ended by a one-shot hardware timer, so the volume doesn't depend on when the control
+//task gets to run. with PUMP_SOFT_START_MS the motor ramps up on LEDC instead of switching straight on.
+//the control loop still tracks each run and stops the output at its own deadline as a backstop.
+
+void pump_driver_init(void); //every zone's pump pin low, after light_output_init (shares the LEDC fade service)
+uint32_t pump_dose_run_us(int zone); //run time for one dose at the calibrated flow, ramp included
+
+bool pump_driver_start(int zone, uint32_t run_us); //false if the reservoir is empty
+void pump_driver_stop(int zone);
+void pump_driver_cut_all_from_isr(void); //reservoir ran dry, every output low right now
+void pump_driver_inhibit(bool on); //while on, every output is low and starts are refused
+void pump_driver_hold_off(void); //inhibit and latch the pins low, right before a restart into new firmware
+
+uint32_t pump_cal_get(int zone); //flow in uL/s
+esp_err_t pump_cal_set(int zone, uint32_t ul_per_s); //applies to the next run and is stored in NVS
+
+#endif
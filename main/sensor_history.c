@@ -0,0 +1,144 @@
+#include "sensor_history.h"
+#include "freertos/FreeRTOS.h"
+#include "can_nodes.h"
+#include "constants.h"
+
+//struct-of-arrays ring, 10 bytes per sample with no padding, read back by sensor_history_latest
+static int16_t hist_temperature[SENSOR_HISTORY_LEN];
+static uint16_t hist_light[SENSOR_HISTORY_LEN];
+static uint16_t hist_humidity[SENSOR_HISTORY_LEN];
+static uint16_t hist_moisture[SENSOR_HISTORY_LEN];
+static uint8_t hist_node[SENSOR_HISTORY_LEN];
+static uint8_t hist_fields[SENSOR_HISTORY_LEN]; //SensorData.fields, a v2 pod can leave some out
+
+static const uint8_t field_bit[HISTORY_FIELD_COUNT] = { CAN_FIELD_TEMPERATURE, CAN_FIELD_LIGHT, CAN_FIELD_HUMIDITY, CAN_FIELD_MOISTURE };
+
+static size_t hist_head = 0; //next write position
+static size_t hist_count = 0;
+
+typedef struct {
+    uint32_t index; //timestamp / window length of the samples inside
+    uint32_t count[HISTORY_FIELD_COUNT]; //samples that carried the field
+    int32_t min[HISTORY_FIELD_COUNT];
+    int32_t max[HISTORY_FIELD_COUNT];
+    int64_t sum[HISTORY_FIELD_COUNT]; //an hour of fast frames overflows 32 bits
+} HistoryBucket;
+
+typedef struct {
+    HistoryBucket current;
+    HistoryBucket completed;
+} HistoryAgg;
+
+static HistoryAgg aggregates[CAN_NODE_COUNT][HISTORY_RES_COUNT];
+static const int64_t window_len_us[HISTORY_RES_COUNT] = { 60000000LL, 3600000000LL };
+
+static portMUX_TYPE history_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static bool bucket_empty(const HistoryBucket *bucket) {
+    for (int f = 0; f < HISTORY_FIELD_COUNT; f++) {
+        if (bucket->count[f] > 0) return false;
+    }
+    return true;
+}
+
+static void bucket_add(HistoryBucket *bucket, uint32_t index, const int32_t *values, uint8_t fields) {
+    if (bucket->index != index) { //first sample of a new window
+        bucket->index = index;
+        for (int f = 0; f < HISTORY_FIELD_COUNT; f++) bucket->count[f] = 0;
+    }
+
+    for (int f = 0; f < HISTORY_FIELD_COUNT; f++) {
+        if (!(fields & field_bit[f])) continue; //a value the pod didn't send this time isn't a new sample of it
+        if (bucket->count[f] == 0) {
+            bucket->min[f] = values[f];
+            bucket->max[f] = values[f];
+            bucket->sum[f] = 0;
+        }
+        if (values[f] < bucket->min[f]) bucket->min[f] = values[f];
+        if (values[f] > bucket->max[f]) bucket->max[f] = values[f];
+        bucket->sum[f] += values[f];
+        bucket->count[f]++;
+    }
+}
+
+void sensor_history_push(const SensorData *data, int64_t timestamp_us) {
+    if (data->node >= CAN_NODE_COUNT) return;
+
+    int32_t values[HISTORY_FIELD_COUNT] = {
+        [HISTORY_FIELD_TEMPERATURE] = data->temperature_raw,
+        [HISTORY_FIELD_LIGHT] = data->light_level,
+        [HISTORY_FIELD_HUMIDITY] = data->humidity,
+        [HISTORY_FIELD_MOISTURE] = data->moisture,
+    };
+
+    portENTER_CRITICAL(&history_lock);
+
+    hist_temperature[hist_head] = data->temperature_raw;
+    hist_light[hist_head] = data->light_level;
+    hist_humidity[hist_head] = data->humidity;
+    hist_moisture[hist_head] = data->moisture;
+    hist_node[hist_head] = data->node;
+    hist_fields[hist_head] = data->fields;
+
+    hist_head = (hist_head + 1) % SENSOR_HISTORY_LEN;
+    if (hist_count < SENSOR_HISTORY_LEN) hist_count++;
+
+    for (int r = 0; r < HISTORY_RES_COUNT; r++) {
+        HistoryAgg *agg = &aggregates[data->node][r];
+        uint32_t index = (uint32_t)(timestamp_us / window_len_us[r]);
+
+        if (!bucket_empty(&agg->current) && agg->current.index != index) { //window rolled over, keep the finished one
+            agg->completed = agg->current;
+        }
+        bucket_add(&agg->current, index, values, data->fields);
+    }
+
+    portEXIT_CRITICAL(&history_lock);
+}
+
+bool sensor_history_stat(uint8_t node, HistoryRes res, HistoryField field, bool completed, HistoryStat *out) {
+    if (node >= CAN_NODE_COUNT || res >= HISTORY_RES_COUNT || field >= HISTORY_FIELD_COUNT) return false;
+
+    portENTER_CRITICAL(&history_lock);
+    const HistoryAgg *agg = &aggregates[node][res];
+    const HistoryBucket *bucket = completed ? &agg->completed : &agg->current;
+
+    out->count = bucket->count[field];
+    if (out->count > 0) {
+        out->min = bucket->min[field];
+        out->max = bucket->max[field];
+        out->mean = (int32_t)(bucket->sum[field] / (int64_t)out->count);
+    } else {
+        out->min = out->max = out->mean = 0;
+    }
+    portEXIT_CRITICAL(&history_lock);
+
+    return out->count > 0;
+}
+
+size_t sensor_history_latest(uint8_t node, HistoryField field, int32_t *out, size_t max_count) {
+    size_t found = 0;
+
+    portENTER_CRITICAL(&history_lock);
+    size_t pos = hist_head;
+    for (size_t i = 0; i < hist_count && found < max_count; i++) { //walk backwards from the newest sample
+        pos = (pos == 0) ? SENSOR_HISTORY_LEN - 1 : pos - 1;
+        if (hist_node[pos] != node || !(hist_fields[pos] & field_bit[field])) continue;
+
+        switch (field) {
+            case HISTORY_FIELD_TEMPERATURE: out[found] = hist_temperature[pos]; break;
+            case HISTORY_FIELD_LIGHT:       out[found] = hist_light[pos]; break;
+            case HISTORY_FIELD_HUMIDITY:    out[found] = hist_humidity[pos]; break;
+            case HISTORY_FIELD_MOISTURE:    out[found] = hist_moisture[pos]; break;
+            default: break;
+        }
+        found++;
+    }
+    portEXIT_CRITICAL(&history_lock);
+
+    return found;
+}
+
+size_t sensor_history_count(void) {
+    return hist_count;
+}
@@ -0,0 +1,45 @@
+#ifndef SENSOR_HISTORY_H
+#define SENSOR_HISTORY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "plant_types.h"
+
+//fixed-size history of every decoded CAN frame, plus per-node min/max/mean aggregates
+//updated incrementally on each push. only the control task pushes, readers may be on any task.
+//the local API serves both: the aggregates in /api/state, the raw values at /api/history.
+
+typedef enum {
+    HISTORY_FIELD_TEMPERATURE, //deci-degrees C
+    HISTORY_FIELD_LIGHT,
+    HISTORY_FIELD_HUMIDITY,
+    HISTORY_FIELD_MOISTURE,
+    HISTORY_FIELD_COUNT
+} HistoryField;
+
+typedef enum {
+    HISTORY_RES_MINUTE,
+    HISTORY_RES_HOUR,
+    HISTORY_RES_COUNT
+} HistoryRes;
+
+typedef struct {
+    int32_t min;
+    int32_t max;
+    int32_t mean;
+    uint32_t count; //samples in the window that carried the field, 0 if there were none
+} HistoryStat;
+
+void sensor_history_push(const SensorData *data, int64_t timestamp_us);
+
+//completed = false returns the window still filling, true returns the last closed one
+bool sensor_history_stat(uint8_t node, HistoryRes res, HistoryField field, bool completed, HistoryStat *out);
+
+//copies up to max_count of the newest raw values for a node into out (newest first), returns how many.
+//samples that left the field out are skipped
+size_t sensor_history_latest(uint8_t node, HistoryField field, int32_t *out, size_t max_count);
+
+size_t sensor_history_count(void);
+
+#endif
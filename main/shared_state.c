@@ -0,0 +1,108 @@
+#include "shared_state.h"
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "can_nodes.h"
+
+//version counts half-steps: odd while a write is in progress, write n goes to buf[n & 1].
+//a reader copies the last complete buffer and only retries if a second write started
+//on that same buffer meanwhile, so a preempted writer never stalls it.
+typedef struct {
+    atomic_uint version;
+} SlotVersion;
+
+static SensorData sensor_buf[CAN_NODE_COUNT][2];
+static SlotVersion sensor_ver[CAN_NODE_COUNT];
+static ThresholdData thresh_buf[CAN_NODE_COUNT][2];
+static SlotVersion thresh_ver[CAN_NODE_COUNT];
+
+static SemaphoreHandle_t sensor_write_mutex; //writers only, readers never touch it
+static SemaphoreHandle_t thresh_write_mutex;
+static atomic_bool water_now_pending = false;
+
+static unsigned write_begin(SlotVersion *ver) {
+    unsigned v = atomic_load_explicit(&ver->version, memory_order_relaxed);
+    atomic_store_explicit(&ver->version, v + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release); //odd version visible before the data changes
+    return ((v >> 1) + 1) & 1; //buffer for this write, the other one stays readable
+}
+
+static void write_end(SlotVersion *ver) {
+    atomic_fetch_add_explicit(&ver->version, 1, memory_order_release);
+}
+
+static unsigned read_begin(SlotVersion *ver, unsigned *buf) {
+    unsigned v = atomic_load_explicit(&ver->version, memory_order_acquire);
+    *buf = (v >> 1) & 1; //last completed write
+    return v & ~1u;
+}
+
+static bool read_retry(SlotVersion *ver, unsigned start) {
+    atomic_thread_fence(memory_order_acquire);
+    unsigned v = atomic_load_explicit(&ver->version, memory_order_relaxed);
+    return v - start >= 3; //the write after next reuses our buffer
+}
+
+void shared_state_init(void) {
+    sensor_write_mutex = xSemaphoreCreateMutex();
+    thresh_write_mutex = xSemaphoreCreateMutex();
+    for (int i = 0; i < (int)CAN_NODE_COUNT; i++) {
+        atomic_init(&sensor_ver[i].version, 0);
+        atomic_init(&thresh_ver[i].version, 0);
+    }
+}
+
+void shared_sensor_write(int node, const SensorData *data) {
+    if (node < 0 || node >= (int)CAN_NODE_COUNT) return;
+    xSemaphoreTake(sensor_write_mutex, portMAX_DELAY);
+    unsigned buf = write_begin(&sensor_ver[node]);
+    sensor_buf[node][buf] = *data;
+    write_end(&sensor_ver[node]);
+    xSemaphoreGive(sensor_write_mutex);
+}
+
+SensorData shared_sensor_read(int node) {
+    SensorData out = {0};
+    if (node < 0 || node >= (int)CAN_NODE_COUNT) return out;
+    unsigned buf, start;
+    do {
+        start = read_begin(&sensor_ver[node], &buf);
+        memcpy(&out, &sensor_buf[node][buf], sizeof(out));
+    } while (read_retry(&sensor_ver[node], start));
+    return out;
+}
+
+void shared_thresholds_write(int node, const ThresholdData *thresh) {
+    int first = (node < 0) ? 0 : node;
+    int last = (node < 0) ? (int)CAN_NODE_COUNT - 1 : node;
+    if (last >= (int)CAN_NODE_COUNT) return;
+
+    xSemaphoreTake(thresh_write_mutex, portMAX_DELAY);
+    for (int i = first; i <= last; i++) {
+        unsigned buf = write_begin(&thresh_ver[i]);
+        thresh_buf[i][buf] = *thresh;
+        write_end(&thresh_ver[i]);
+    }
+    xSemaphoreGive(thresh_write_mutex);
+}
+
+ThresholdData shared_thresholds_read(int node) {
+    ThresholdData out = {0};
+    if (node < 0 || node >= (int)CAN_NODE_COUNT) return out;
+    unsigned buf, start;
+    do {
+        start = read_begin(&thresh_ver[node], &buf);
+        memcpy(&out, &thresh_buf[node][buf], sizeof(out));
+    } while (read_retry(&thresh_ver[node], start));
+    return out;
+}
+
+void shared_request_water_now(void) {
+    atomic_store(&water_now_pending, true);
+}
+
+bool shared_take_water_now(void) {
+    return atomic_exchange(&water_now_pending, false);
+}
@@ -0,0 +1,23 @@
+#ifndef SHARED_STATE_H
+#define SHARED_STATE_H
+
+#include <stdbool.h>
+#include "plant_types.h"
+
+//latest sensor frame and thresholds per CAN node, shared between the control loop and the network tasks.
+//each slot is a versioned double buffer: readers never take a lock and never wait on a writer,
+//writers only serialize against each other.
+
+void shared_state_init(void); //before any task is created
+
+void shared_sensor_write(int node, const SensorData *data);
+SensorData shared_sensor_read(int node);
+
+void shared_thresholds_write(int node, const ThresholdData *thresh); //node < 0 writes every slot
+ThresholdData shared_thresholds_read(int node);
+
+//water-now is an event, not a level: raised once per button press, consumed once by the control loop
+void shared_request_water_now(void);
+bool shared_take_water_now(void);
+
+#endif
@@ -0,0 +1,43 @@
+#!/usr/bin/env python3
+"""Generate the light level -> LEDC duty gamma table (light_gamma.h) at build time."""
+import argparse
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument('--levels', type=int, required=True, help='number of control levels (table entries)')
+    parser.add_argument('--bits', type=int, required=True, help='LEDC duty resolution')
+    parser.add_argument('--gamma', type=float, required=True)
+    parser.add_argument('--output', required=True)
+    args = parser.parse_args()
+
+    duty_max = (1 << args.bits) - 1
+    table = []
+    for level in range(args.levels):
+        duty = round(duty_max * (level / (args.levels - 1)) ** args.gamma)
+        if level > 0 and duty == 0:
+            duty = 1  # every level above 0 must light the fixture
+        table.append(duty)
+
+    lines = [
+        '//generated by tools/gen_light_gamma.py, do not edit',
+        '#ifndef LIGHT_GAMMA_H',
+        '#define LIGHT_GAMMA_H',
+        '',
+        '#include <stdint.h>',
+        '',
+        '#define LIGHT_GAMMA_LEVELS {}'.format(args.levels),
+        '#define LIGHT_GAMMA_DUTY_BITS {}'.format(args.bits),
+        '',
+        'static const uint16_t light_gamma_table[LIGHT_GAMMA_LEVELS] = {',
+    ]
+    for i in range(0, len(table), 16):
+        lines.append('    ' + ', '.join(str(d) for d in table[i:i + 16]) + ',')
+    lines += ['};', '', '#endif', '']
+
+    with open(args.output, 'w') as f:
+        f.write('\n'.join(lines))
+
+
+if __name__ == '__main__':
+    main()
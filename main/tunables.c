@@ -0,0 +1,92 @@
+#include "tunables.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "nvs.h"
+#include "constants.h"
+
+#define TUNE_NVS_NAMESPACE "tune"
+
+typedef struct {
+    const char *name; //console name and NVS key, at most 15 characters
+    uint32_t def;
+    uint32_t min;
+    uint32_t max;
+} TunableDef;
+
+static const TunableDef tunable_defs[TUNE_COUNT] = {
+    [TUNE_LUX_LOW] = { "lux_low", LUX_TARGET_LOW, 0, 65535 },
+    [TUNE_LUX_MEDIUM] = { "lux_medium", LUX_TARGET_MEDIUM, 0, 65535 },
+    [TUNE_LUX_HIGH] = { "lux_high", LUX_TARGET_HIGH, 0, 65535 },
+    [TUNE_PUMP_COOLDOWN_S] = { "cooldown_s", PUMP_COOLDOWN / 1000000ULL, 1, 86400 },
+    [TUNE_PUMP_DOSE_ML] = { "dose_ml", PUMP_DOSE_ML, 1, 2000 },
+};
+
+_Static_assert(TUNE_LUX_HIGH - TUNE_LUX_LOW + 1 == LUX_LEVELS, "one lux tunable per light intensity level");
+
+static atomic_uint values[TUNE_COUNT];
+
+void tunables_init(void) {
+    nvs_handle_t handle;
+    bool opened = nvs_open(TUNE_NVS_NAMESPACE, NVS_READONLY, &handle) == ESP_OK;
+    for (int i = 0; i < TUNE_COUNT; i++) {
+        const TunableDef *def = &tunable_defs[i];
+        uint32_t value = def->def;
+        if (opened && nvs_get_u32(handle, def->name, &value) == ESP_OK && (value < def->min || value > def->max)) {
+            value = def->def; //stored by a build with other limits
+        }
+        if (value != def->def) printf("tunable %s = %u (build default %u)\n", def->name, (unsigned)value, (unsigned)def->def);
+        atomic_store(&values[i], value);
+    }
+    if (opened) nvs_close(handle);
+}
+
+uint32_t tunable_get(Tunable which) {
+    if (which >= TUNE_COUNT) return 0;
+    return atomic_load(&values[which]);
+}
+
+esp_err_t tunable_set(Tunable which, uint32_t value) {
+    if (which >= TUNE_COUNT || value < tunable_defs[which].min || value > tunable_defs[which].max) return ESP_ERR_INVALID_ARG;
+    atomic_store(&values[which], value); //the control loop picks it up on its next step, stored or not
+
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(TUNE_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err != ESP_OK) return err;
+    err = nvs_set_u32(handle, tunable_defs[which].name, value);
+    if (err == ESP_OK) err = nvs_commit(handle);
+    nvs_close(handle);
+    return err;
+}
+
+esp_err_t tunable_reset(Tunable which) {
+    if (which >= TUNE_COUNT) return ESP_ERR_INVALID_ARG;
+    atomic_store(&values[which], tunable_defs[which].def);
+
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(TUNE_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err != ESP_OK) return err;
+    err = nvs_erase_key(handle, tunable_defs[which].name);
+    if (err == ESP_ERR_NVS_NOT_FOUND) err = ESP_OK; //was never stored
+    if (err == ESP_OK) err = nvs_commit(handle);
+    nvs_close(handle);
+    return err;
+}
+
+int tunable_find(const char *name) {
+    for (int i = 0; i < TUNE_COUNT; i++) {
+        if (strcmp(name, tunable_defs[i].name) == 0) return i;
+    }
+    return -1;
+}
+
+const char *tunable_name(Tunable which) {
+    return (which < TUNE_COUNT) ? tunable_defs[which].name : "";
+}
+
+void tunable_range(Tunable which, uint32_t *min, uint32_t *max, uint32_t *def) {
+    if (which >= TUNE_COUNT) return;
+    *min = tunable_defs[which].min;
+    *max = tunable_defs[which].max;
+    *def = tunable_defs[which].def;
+}
@@ -0,0 +1,28 @@
+#ifndef TUNABLES_H
+#define TUNABLES_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+//settings that change per bed rather than per board, so every board of a kind runs the same image.
+//the defaults come from the timing profile in menuconfig, a value set from the console is stored in
+//NVS over its default and read back on the next boot. reads are lock free from any task.
+
+typedef enum {
+    TUNE_LUX_LOW, //lux for light intensity 1
+    TUNE_LUX_MEDIUM,
+    TUNE_LUX_HIGH,
+    TUNE_PUMP_COOLDOWN_S, //wait after a run before the zone can water again
+    TUNE_PUMP_DOSE_ML, //water per run, the flow calibration turns it into a run time
+    TUNE_COUNT
+} Tunable;
+
+void tunables_init(void); //after NVS init, before the control task starts
+uint32_t tunable_get(Tunable which);
+esp_err_t tunable_set(Tunable which, uint32_t value); //applies right away and is stored in NVS, ESP_ERR_INVALID_ARG out of range
+esp_err_t tunable_reset(Tunable which); //back to the build default, the stored value is erased
+int tunable_find(const char *name); //-1 if no tunable has that name
+const char *tunable_name(Tunable which);
+void tunable_range(Tunable which, uint32_t *min, uint32_t *max, uint32_t *def);
+
+#endif
@@ -0,0 +1,205 @@
+#include "upload_log.h"
+#include <string.h>
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+#include "esp_log.h"
+#include "constants.h"
+#include "upload_filter.h"
+
+#define LOG_SECTOR_SIZE 4096
+#define LOG_STATE_ERASED 0xFF
+#define LOG_STATE_WRITTEN 0xFE //bits can only be cleared without an erase, so each state clears one more
+#define LOG_STATE_SENT 0xFC
+
+typedef struct {
+    uint8_t state;
+    uint8_t node;
+    uint16_t crc; //over everything after this field
+    uint32_t seq;
+    int64_t created_at;
+    int16_t temperature_raw;
+    uint16_t light_level;
+    uint16_t humidity;
+    uint16_t moisture;
+    uint8_t water_level;
+    uint8_t feeds; //UploadSample.feeds, records from before it existed read back as 0xFF, all feeds
+    uint8_t unsent; //left erased when written, a bit is cleared once its feed is sent. not covered by the crc
+    uint8_t reserved;
+    uint32_t taken_s; //esp_timer seconds, for records logged before SNTP set the clock
+} LogRecord;
+
+_Static_assert(sizeof(LogRecord) == 32, "log records must stay 32 bytes");
+_Static_assert(LOG_SECTOR_SIZE % sizeof(LogRecord) == 0, "records must not straddle sectors");
+
+#define RECORDS_PER_SECTOR (LOG_SECTOR_SIZE / sizeof(LogRecord))
+
+static const char *TAG = "UPLOAD_LOG";
+static const esp_partition_t *log_partition = NULL;
+static size_t log_capacity = 0; //records in the partition
+static size_t log_head = 0; //next record to write
+static size_t log_tail = 0; //oldest record that may still be unsent
+static size_t log_pending = 0;
+static uint32_t log_next_seq = 1;
+
+static uint16_t record_crc(const LogRecord *rec) {
+    LogRecord copy = *rec;
+    copy.unsent = 0xFF; //as written, so clearing bits later doesn't break the record
+    const uint8_t *start = (const uint8_t *)&copy.seq;
+    return esp_rom_crc16_le(0, start, sizeof(LogRecord) - offsetof(LogRecord, seq));
+}
+
+static bool read_record(size_t index, LogRecord *rec) {
+    if (esp_partition_read(log_partition, index * sizeof(LogRecord), rec, sizeof(LogRecord)) != ESP_OK) return false;
+    return rec->state != LOG_STATE_ERASED && rec->crc == record_crc(rec);
+}
+
+static void mark_sent(size_t index) {
+    uint8_t state = LOG_STATE_SENT;
+    esp_partition_write(log_partition, index * sizeof(LogRecord), &state, 1);
+}
+
+static void mark_unsent_feeds(size_t index, uint8_t feeds) { //only clears bits, so no erase is needed
+    esp_partition_write(log_partition, index * sizeof(LogRecord) + offsetof(LogRecord, unsent), &feeds, 1);
+}
+
+esp_err_t upload_log_init(void) {
+    log_partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, UPLOAD_LOG_PARTITION_SUBTYPE, UPLOAD_LOG_PARTITION_LABEL);
+    if (log_partition == NULL) {
+        ESP_LOGE(TAG, "no '%s' partition, offline uploads will be lost", UPLOAD_LOG_PARTITION_LABEL);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    log_capacity = (log_partition->size / LOG_SECTOR_SIZE) * RECORDS_PER_SECTOR;
+    log_head = log_tail = log_pending = 0;
+
+    //one pass over the partition rebuilds head (after the newest record) and tail (oldest unsent one)
+    uint32_t newest_seq = 0, oldest_unsent_seq = UINT32_MAX;
+    bool found_unsent = false;
+    size_t undated = 0;
+    LogRecord rec;
+
+    for (size_t i = 0; i < log_capacity; i++) {
+        if (!read_record(i, &rec)) continue;
+
+        if (rec.seq >= newest_seq) {
+            newest_seq = rec.seq;
+            log_head = (i + 1) % log_capacity;
+        }
+        if (rec.state == LOG_STATE_WRITTEN && rec.created_at == 0) { //taken before SNTP on an earlier boot, its uptime can't be dated now
+            mark_sent(i);
+            undated++;
+            continue;
+        }
+        if (rec.state == LOG_STATE_WRITTEN) {
+            log_pending++;
+            if (rec.seq < oldest_unsent_seq) {
+                oldest_unsent_seq = rec.seq;
+                log_tail = i;
+                found_unsent = true;
+            }
+        }
+    }
+
+    if (!found_unsent) log_tail = log_head;
+    log_next_seq = newest_seq + 1;
+
+    if (undated > 0) ESP_LOGW(TAG, "dropped %u samples from before a reboot that never got a timestamp", (unsigned)undated);
+    ESP_LOGI(TAG, "%u records, %u waiting to be uploaded", (unsigned)log_capacity, (unsigned)log_pending);
+    return ESP_OK;
+}
+
+bool upload_log_append(const UploadSample *sample) {
+    if (log_partition == NULL) return false;
+
+    if (log_head % RECORDS_PER_SECTOR == 0) { //entering a sector, erase it first
+        size_t sector_end = log_head + RECORDS_PER_SECTOR;
+
+        for (size_t i = log_head; i < sector_end; i++) { //log is full, drop the oldest sector's unsent records
+            LogRecord old;
+            if (read_record(i, &old) && old.state == LOG_STATE_WRITTEN && log_pending > 0) log_pending--;
+        }
+        if (log_pending > 0 && log_tail >= log_head && log_tail < sector_end) {
+            log_tail = sector_end % log_capacity;
+        }
+
+        if (esp_partition_erase_range(log_partition, log_head * sizeof(LogRecord), LOG_SECTOR_SIZE) != ESP_OK) {
+            return false;
+        }
+    }
+
+    LogRecord rec = {
+        .state = LOG_STATE_WRITTEN,
+        .node = sample->data.node,
+        .seq = log_next_seq++,
+        .created_at = sample->created_at,
+        .temperature_raw = sample->data.temperature_raw,
+        .light_level = sample->data.light_level,
+        .humidity = sample->data.humidity,
+        .moisture = sample->data.moisture,
+        .water_level = sample->data.water_level ? 1 : 0,
+        .feeds = sample->feeds,
+        .unsent = 0xFF,
+        .reserved = 0xFF,
+        .taken_s = (uint32_t)(sample->taken_us / 1000000),
+    };
+    rec.crc = record_crc(&rec);
+
+    if (esp_partition_write(log_partition, log_head * sizeof(LogRecord), &rec, sizeof(rec)) != ESP_OK) {
+        return false;
+    }
+
+    if (log_pending == 0) log_tail = log_head;
+    log_pending++;
+    log_head = (log_head + 1) % log_capacity;
+    return true;
+}
+
+size_t upload_log_peek(UploadSample *out, size_t max_count) {
+    size_t found = 0;
+    LogRecord rec;
+
+    for (size_t i = log_tail; i != log_head && found < max_count; i = (i + 1) % log_capacity) {
+        if (!read_record(i, &rec) || rec.state != LOG_STATE_WRITTEN) continue;
+
+        UploadSample *s = &out[found++];
+        memset(s, 0, sizeof(*s));
+        s->created_at = rec.created_at;
+        s->taken_us = (int64_t)rec.taken_s * 1000000;
+        s->data.node = rec.node;
+        s->data.temperature_raw = rec.temperature_raw;
+        s->data.temperature = rec.temperature_raw / 10.0f;
+        s->data.light_level = rec.light_level;
+        s->data.humidity = rec.humidity;
+        s->data.moisture = rec.moisture;
+        s->data.water_level = rec.water_level != 0;
+        s->feeds = rec.feeds & rec.unsent & UPLOAD_FEEDS_ALL;
+    }
+
+    return found;
+}
+
+void upload_log_ack(const UploadSample *samples, size_t count) {
+    LogRecord rec;
+    size_t n = 0;
+
+    for (size_t i = log_tail; i != log_head && n < count; i = (i + 1) % log_capacity) { //same walk as upload_log_peek()
+        if (!read_record(i, &rec) || rec.state != LOG_STATE_WRITTEN) continue;
+
+        uint8_t left = samples[n++].feeds;
+        if (left == 0) {
+            mark_sent(i);
+            log_pending--;
+        } else if (left != (rec.feeds & rec.unsent & UPLOAD_FEEDS_ALL)) {
+            mark_unsent_feeds(i, rec.unsent & left);
+        }
+    }
+
+    while (log_tail != log_head && !(read_record(log_tail, &rec) && rec.state == LOG_STATE_WRITTEN)) { //up to the oldest record still owed
+        log_tail = (log_tail + 1) % log_capacity;
+    }
+    if (log_pending == 0) log_tail = log_head;
+}
+
+size_t upload_log_pending(void) {
+    return log_pending;
+}
@@ -0,0 +1,25 @@
+#ifndef UPLOAD_LOG_H
+#define UPLOAD_LOG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "plant_types.h"
+
+//flash-backed store-and-forward log for samples that couldn't be uploaded.
+//lives in its own data partition and is written as a circular log of fixed-size records,
+//so every sector gets erased once per lap. only adafruit_tx_task may call these.
+
+esp_err_t upload_log_init(void);
+bool upload_log_append(const UploadSample *sample);
+
+//reads up to max_count of the oldest unsent samples without removing them
+size_t upload_log_peek(UploadSample *out, size_t max_count);
+
+//takes back the first count samples returned by upload_log_peek() after publish_batch cleared the feeds it was done
+//with. a record with no feeds left is marked sent, the others are only offered their remaining feeds next time
+void upload_log_ack(const UploadSample *samples, size_t count);
+
+size_t upload_log_pending(void);
+
+#endif
@@ -0,0 +1,83 @@
+#include "warm_boot.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_attr.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "constants.h"
+
+#define WARM_NVS_NAMESPACE "warm"
+#define WARM_NVS_KEY_THRESH "thresh"
+#define WARM_CLOCK_MAGIC 0x434c4b31u //"CLK1"
+
+typedef struct { //in RTC slow memory, survives every reset but a power-on one
+    uint32_t magic;
+    uint32_t check; //magic ^ both halves of unix_us, catches a half written snapshot or garbage after power loss
+    int64_t unix_us; //wall clock at the snapshot
+} ClockSnapshot;
+
+static RTC_NOINIT_ATTR ClockSnapshot clock_snapshot;
+static SemaphoreHandle_t store_lock; //the cloud pull and the local API both save
+static ThresholdData stored_thresh; //mirrors NVS, under store_lock after boot
+static bool stored_valid = false;
+
+static uint32_t snapshot_check(int64_t unix_us) {
+    return WARM_CLOCK_MAGIC ^ (uint32_t)unix_us ^ (uint32_t)((uint64_t)unix_us >> 32);
+}
+
+bool warm_boot_load_thresholds(ThresholdData *thresh) {
+    store_lock = xSemaphoreCreateMutex();
+    nvs_handle_t handle;
+    if (nvs_open(WARM_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) return false;
+    size_t len = sizeof(stored_thresh);
+    stored_valid = nvs_get_blob(handle, WARM_NVS_KEY_THRESH, &stored_thresh, &len) == ESP_OK && len == sizeof(stored_thresh);
+    nvs_close(handle);
+
+    if (stored_valid) *thresh = stored_thresh;
+    return stored_valid;
+}
+
+void warm_boot_save_thresholds(const ThresholdData *thresh) {
+    ThresholdData next = *thresh;
+    next.water_now = 0; //a button press is an event, it must not replay after a reboot
+    xSemaphoreTake(store_lock, portMAX_DELAY);
+    nvs_handle_t handle;
+    if ((!stored_valid || memcmp(&next, &stored_thresh, sizeof(next)) != 0) && nvs_open(WARM_NVS_NAMESPACE, NVS_READWRITE, &handle) == ESP_OK) {
+        if (nvs_set_blob(handle, WARM_NVS_KEY_THRESH, &next, sizeof(next)) == ESP_OK && nvs_commit(handle) == ESP_OK) {
+            stored_thresh = next;
+            stored_valid = true;
+        }
+        nvs_close(handle);
+    }
+    xSemaphoreGive(store_lock);
+}
+
+bool warm_boot_restore_clock(void) {
+    if (time(NULL) > CLOCK_VALID_AFTER) return false; //the RTC kept the time through the reset, nothing to do
+    esp_reset_reason_t reason = esp_reset_reason();
+    if (reason == ESP_RST_POWERON || reason == ESP_RST_UNKNOWN) return false; //RTC memory is garbage and the outage length unknown
+    if (clock_snapshot.magic != WARM_CLOCK_MAGIC || clock_snapshot.check != snapshot_check(clock_snapshot.unix_us)) return false;
+    if (clock_snapshot.unix_us / 1000000 <= CLOCK_VALID_AFTER) return false;
+
+    //behind by the time between the last snapshot and the reset, a few seconds with frames arriving. SNTP corrects it
+    int64_t unix_us = clock_snapshot.unix_us + esp_timer_get_time();
+    struct timeval tv = { .tv_sec = unix_us / 1000000, .tv_usec = unix_us % 1000000 };
+    if (settimeofday(&tv, NULL) != 0) return false;
+    printf("clock resumed from before the reset (reason %d), waiting for SNTP to confirm\n", (int)reason);
+    return true;
+}
+
+void warm_boot_clock_snapshot(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    if (tv.tv_sec <= CLOCK_VALID_AFTER) return; //never snapshot an unsynced clock
+    int64_t unix_us = (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+    clock_snapshot.unix_us = unix_us;
+    clock_snapshot.check = snapshot_check(unix_us);
+    clock_snapshot.magic = WARM_CLOCK_MAGIC;
+}
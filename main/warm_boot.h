@@ -0,0 +1,16 @@
+#ifndef WARM_BOOT_H
+#define WARM_BOOT_H
+
+#include <stdbool.h>
+#include "plant_types.h"
+
+//state that lets the controller pick up where it left off after a reset instead of waiting on the cloud.
+//thresholds (the light schedule is part of them) are cached in NVS and only rewritten when they change.
+//the wall clock is snapshotted to RTC memory, no flash writes, and brought back after any reset that kept it.
+
+bool warm_boot_load_thresholds(ThresholdData *thresh); //after NVS init and before any save, false leaves thresh untouched
+void warm_boot_save_thresholds(const ThresholdData *thresh); //no flash write if nothing changed
+bool warm_boot_restore_clock(void); //before the control task starts, true if the clock was set from the snapshot
+void warm_boot_clock_snapshot(void); //from the control loop, cheap RAM write once SNTP or a restore set the clock
+
+#endif
@@ -0,0 +1,195 @@
+#include "wifi_link.h"
+#include <stdio.h>
+#include <string.h>
+#include "esp_wifi.h"
+#include "esp_netif.h"
+#include "esp_event.h"
+#include "esp_timer.h"
+#include "esp_random.h"
+#include "nvs.h"
+#include "constants.h"
+#include "power_mgmt.h"
+#include "perf_stats.h"
+#include "secrets.h"
+
+#define WIFI_NVS_NAMESPACE "wifi"
+#define WIFI_NVS_KEY "ap"
+
+typedef struct { //last AP that handed out an IP, stored as one blob
+    uint8_t bssid[6];
+    uint8_t channel;
+    uint8_t has_ip; //the lease below is valid (WIFI_CACHE_STATIC_IP)
+    uint32_t ip;
+    uint32_t netmask;
+    uint32_t gw;
+    uint32_t dns;
+} WifiApCache;
+
+static EventGroupHandle_t link_events;
+static esp_netif_t *sta_netif;
+static esp_timer_handle_t retry_timer; //one-shot, reconnects once the backoff delay is over
+static wifi_config_t sta_config;
+
+//everything below is only touched from the event loop task once wifi_link_init returns
+static WifiApCache cache; //mirrors NVS
+static bool cache_valid = false;
+static WifiApCache joined; //BSSID/channel of the current association, saved once an IP arrives
+static bool pinned = false; //sta_config is locked to the cached BSSID/channel
+static bool static_ip = false; //DHCP is off and the cached lease is in use
+static uint32_t attempts = 0; //failed joins since the last IP
+
+static void cache_load(void) {
+    nvs_handle_t handle;
+    if (nvs_open(WIFI_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) return;
+    size_t len = sizeof(cache);
+    cache_valid = nvs_get_blob(handle, WIFI_NVS_KEY, &cache, &len) == ESP_OK && len == sizeof(cache) && cache.channel != 0;
+    nvs_close(handle);
+}
+
+static void cache_store(const WifiApCache *next) {
+    if (cache_valid && memcmp(next, &cache, sizeof(cache)) == 0) return; //flash is only written when the AP or lease changed
+    nvs_handle_t handle;
+    if (nvs_open(WIFI_NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) return;
+    if (nvs_set_blob(handle, WIFI_NVS_KEY, next, sizeof(*next)) == ESP_OK && nvs_commit(handle) == ESP_OK) {
+        cache = *next;
+        cache_valid = true;
+    }
+    nvs_close(handle);
+}
+
+static void pin_to_cache(bool pin) {
+    sta_config.sta.bssid_set = pin;
+    if (pin) {
+        memcpy(sta_config.sta.bssid, cache.bssid, sizeof(cache.bssid));
+        sta_config.sta.channel = cache.channel;
+        sta_config.sta.scan_method = WIFI_FAST_SCAN; //probe the one channel, join the first match
+    } else {
+        sta_config.sta.channel = 0;
+        sta_config.sta.scan_method = WIFI_ALL_CHANNEL_SCAN; //strongest AP with our SSID on any channel
+        sta_config.sta.sort_method = WIFI_CONNECT_AP_BY_SIGNAL;
+    }
+    esp_wifi_set_config(WIFI_IF_STA, &sta_config);
+    pinned = pin;
+}
+
+static void use_static_ip(bool on) {
+    if (on) {
+        esp_netif_dhcpc_stop(sta_netif);
+        esp_netif_ip_info_t ip = { .ip.addr = cache.ip, .netmask.addr = cache.netmask, .gw.addr = cache.gw };
+        esp_netif_set_ip_info(sta_netif, &ip); //GOT_IP is posted as soon as the link comes up
+        esp_netif_dns_info_t dns = { .ip.u_addr.ip4.addr = cache.dns, .ip.type = ESP_IPADDR_TYPE_V4 };
+        esp_netif_set_dns_info(sta_netif, ESP_NETIF_DNS_MAIN, &dns);
+    } else {
+        esp_netif_dhcpc_start(sta_netif);
+    }
+    static_ip = on;
+}
+
+static uint32_t backoff_ms(uint32_t attempt) { //window doubles per attempt up to the cap, the delay is drawn from its upper half
+    uint32_t window = WIFI_BACKOFF_MAX_MS;
+    if (attempt < 16 && ((uint32_t)WIFI_BACKOFF_MIN_MS << attempt) < WIFI_BACKOFF_MAX_MS) window = (uint32_t)WIFI_BACKOFF_MIN_MS << attempt;
+    return window / 2 + esp_random() % (window / 2 + 1); //jitter keeps boards that dropped together from retrying together
+}
+
+static void retry_timer_cb(void *arg) {
+    if (esp_wifi_connect() != ESP_OK) { //no disconnect event follows a refused call, so schedule the next try here
+        esp_timer_start_once(retry_timer, WIFI_BACKOFF_MAX_MS * 1000ULL);
+    }
+}
+
+static void wifi_event_handler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data) {
+    if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
+        esp_wifi_connect();
+    }
+    else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_CONNECTED) {
+        const wifi_event_sta_connected_t *info = (const wifi_event_sta_connected_t *)event_data;
+        memcpy(joined.bssid, info->bssid, sizeof(joined.bssid));
+        joined.channel = info->channel;
+    }
+    else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
+        const wifi_event_sta_disconnected_t *info = (const wifi_event_sta_disconnected_t *)event_data;
+        xEventGroupClearBits(link_events, WIFI_LINK_UP_BIT);
+        xEventGroupSetBits(link_events, WIFI_LINK_DOWN_BIT);
+        perf_count(PERF_WIFI_DISCONNECT, 1);
+
+        attempts++;
+        if (pinned && attempts >= WIFI_CACHE_MAX_FAILS) { //AP moved channel or was replaced, go back to a full scan
+            printf(" WIFI UPDATE: cached AP not answering, scanning all channels\n");
+            if (static_ip) use_static_ip(false);
+            pin_to_cache(false);
+        }
+
+        uint32_t delay_ms = backoff_ms(attempts - 1);
+        printf(" WIFI UPDATE: wifi connection lost or failed (reason %u), retrying in %u ms\n", (unsigned)info->reason, (unsigned)delay_ms);
+        esp_timer_stop(retry_timer); //fails harmlessly if it wasn't running
+        esp_timer_start_once(retry_timer, delay_ms * 1000ULL);
+    }
+    else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
+        const ip_event_got_ip_t *got = (const ip_event_got_ip_t *)event_data;
+        attempts = 0;
+
+        WifiApCache next = {0};
+        memcpy(next.bssid, joined.bssid, sizeof(next.bssid));
+        next.channel = joined.channel;
+        if (WIFI_CACHE_STATIC_IP) {
+            esp_netif_dns_info_t dns = {0};
+            esp_netif_get_dns_info(sta_netif, ESP_NETIF_DNS_MAIN, &dns);
+            next.has_ip = 1;
+            next.ip = got->ip_info.ip.addr;
+            next.netmask = got->ip_info.netmask.addr;
+            next.gw = got->ip_info.gw.addr;
+            next.dns = dns.ip.u_addr.ip4.addr;
+        }
+        cache_store(&next);
+
+        printf(" WIFI UPDATE: wifi connected on channel %u\n", joined.channel);
+        xEventGroupClearBits(link_events, WIFI_LINK_DOWN_BIT);
+        xEventGroupSetBits(link_events, WIFI_LINK_UP_BIT); //adafruit_tx_task starts draining the offline log
+    }
+}
+
+void wifi_link_init(void) {
+    link_events = xEventGroupCreate();
+    xEventGroupSetBits(link_events, WIFI_LINK_DOWN_BIT);
+
+    ESP_ERROR_CHECK(esp_netif_init());
+    ESP_ERROR_CHECK(esp_event_loop_create_default());
+    sta_netif = esp_netif_create_default_wifi_sta();
+
+    wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
+    ESP_ERROR_CHECK(esp_wifi_init(&cfg));
+
+    esp_timer_create_args_t args = { .callback = retry_timer_cb, .dispatch_method = ESP_TIMER_TASK, .name = "wifi_retry" };
+    ESP_ERROR_CHECK(esp_timer_create(&args, &retry_timer));
+
+    ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &wifi_event_handler, NULL, NULL));
+    ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &wifi_event_handler, NULL, NULL));
+
+    strncpy((char*)sta_config.sta.ssid, WIFI_SSID, sizeof(sta_config.sta.ssid));
+    strncpy((char*)sta_config.sta.password, WIFI_PASS, sizeof(sta_config.sta.password));
+    sta_config.sta.listen_interval = POWER_WIFI_LISTEN_INTERVAL; //only used with WIFI_PS_MAX_MODEM
+
+    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
+    cache_load();
+    pin_to_cache(cache_valid);
+    if (cache_valid) {
+        printf("joining cached AP on channel %u\n", cache.channel);
+        if (WIFI_CACHE_STATIC_IP && cache.has_ip) use_static_ip(true);
+    }
+
+    printf("starting wifi driver\n");
+    ESP_ERROR_CHECK(esp_wifi_start());
+    ESP_ERROR_CHECK(esp_wifi_set_ps(power_low_power_enabled() ? WIFI_PS_MAX_MODEM : WIFI_PS_NONE)); //modem sleep between DTIM beacons in low-power mode
+}
+
+bool wifi_link_is_up(void) {
+    return (xEventGroupGetBits(link_events) & WIFI_LINK_UP_BIT) != 0;
+}
+
+bool wifi_link_wait_up(TickType_t timeout) {
+    return (xEventGroupWaitBits(link_events, WIFI_LINK_UP_BIT, pdFALSE, pdFALSE, timeout) & WIFI_LINK_UP_BIT) != 0;
+}
+
+EventGroupHandle_t wifi_link_events(void) {
+    return link_events;
+}
@@ -0,0 +1,20 @@
+#ifndef WIFI_LINK_H
+#define WIFI_LINK_H
+
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+
+//station link to the AP. reconnects back off exponentially with jitter instead of hammering the AP,
+//and the last good BSSID/channel (and optionally the DHCP lease) are kept in NVS so a reboot joins
+//without a full channel scan. the network tasks block on the event group instead of polling a flag.
+
+#define WIFI_LINK_UP_BIT (1u << 0) //associated and holding an IP
+#define WIFI_LINK_DOWN_BIT (1u << 1) //the inverse, so tasks can also wait for a drop
+
+void wifi_link_init(void); //NVS must already be initialised
+bool wifi_link_is_up(void);
+bool wifi_link_wait_up(TickType_t timeout); //true once the link is up, false on timeout
+EventGroupHandle_t wifi_link_events(void);
+
+#endif
@@ -0,0 +1,136 @@
+#include "replay.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "can_frame.h"
+#include "threshold_parser.h"
+#include "plant_control.h"
+
+#define BENCH_MIN_NS 200000000LL //each benchmark runs for at least 0.2 s of wall time
+
+static volatile uint32_t bench_sink; //keeps results alive so nothing is optimized out
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void report(const char *name, int64_t ns, uint64_t ops, uint64_t bytes) {
+    double per_op = (double)ns / ops;
+    printf("  %-16s %10.1f ns/op %12.0f ops/s", name, per_op, 1e9 / per_op);
+    if (bytes > 0) printf(" %8.1f MB/s", bytes / (ns / 1e9) / 1e6);
+    printf("\n");
+}
+
+static void bench_decode(const TraceFrame *frames, size_t count) {
+    static CanDecoder decoder;
+    can_decoder_init(&decoder);
+    uint64_t ops = 0;
+    int64_t start = now_ns(), elapsed;
+    SensorData data;
+    do {
+        for (size_t i = 0; i < count; i++) {
+            bench_sink += can_decoder_feed(&decoder, frames[i].id, frames[i].extd, frames[i].dlc, frames[i].data, &data);
+        }
+        ops += count;
+    } while ((elapsed = now_ns() - start) < BENCH_MIN_NS);
+    report("can decode", elapsed, ops, 0);
+}
+
+static void bench_decode_v2(void) { //full v2 pod message, reassembled from its frames
+    static CanDecoder decoder;
+    can_decoder_init(&decoder);
+    decoder.protocol[0] = CAN_PROTOCOL_V2;
+
+    SensorData sample = { .temperature_raw = 215, .light_level = 900, .humidity = 55, .moisture = 400,
+                          .ec = 1200, .ph_centi = 620, .co2 = 800, .node_time_ms = 123456 };
+    uint8_t frames[4][8];
+    uint8_t dlcs[4];
+
+    uint64_t ops = 0;
+    int64_t start = now_ns(), elapsed;
+    SensorData data;
+    do {
+        for (int seq = 0; seq < 16; seq++) {
+            size_t n = can_v2_encode(&sample, 0xFF, seq, frames, dlcs, 4);
+            for (size_t i = 0; i < n; i++) bench_sink += can_decoder_feed(&decoder, can_node_ids[0], false, dlcs[i], frames[i], &data);
+        }
+        ops += 16;
+    } while ((elapsed = now_ns() - start) < BENCH_MIN_NS);
+    report("v2 encode+decode", elapsed, ops, 0);
+}
+
+static void bench_parse(const TraceResponse *response, size_t chunk) {
+    uint64_t ops = 0;
+    int64_t start = now_ns(), elapsed;
+    do {
+        ThresholdData thresh = {0};
+        ThresholdParser parser;
+        threshold_parser_init(&parser, &thresh);
+        for (size_t off = 0; off < response->len; off += chunk) {
+            size_t n = (response->len - off < chunk) ? response->len - off : chunk;
+            threshold_parser_feed(&parser, response->body + off, n);
+        }
+        bench_sink += threshold_parser_finish(&parser);
+        ops++;
+    } while ((elapsed = now_ns() - start) < BENCH_MIN_NS);
+
+    char name[32];
+    snprintf(name, sizeof(name), "parse %uB chunks", (unsigned)chunk);
+    report(name, elapsed, ops, ops * response->len);
+}
+
+static void bench_control(void) {
+    static PlantControl ctl;
+    plant_control_init(&ctl);
+
+    ThresholdData thresh[ZONE_COUNT];
+    SensorData data[ZONE_COUNT];
+    for (int z = 0; z < (int)ZONE_COUNT; z++) {
+        thresh[z] = (ThresholdData){ .light_intensity = 2, .moisture = 300, .temperature = 25, .on_off_toggle = 1, .light_hours = 12.0 };
+        data[z] = (SensorData){ .temperature = 21.5f, .light_level = 900, .humidity = 55, .moisture = 400, .water_level = true,
+                               .fields = CAN_FIELDS_V1, .known = CAN_FIELDS_V1, .raw_id = 0x101 };
+    }
+    struct tm local_time = { .tm_year = 2025 - 1900, .tm_mon = 5, .tm_mday = 1, .tm_hour = 12 }; //inside the light window
+
+    uint64_t ops = 0;
+    int64_t start = now_ns(), elapsed;
+    PlantActions actions;
+    int64_t now_us = 0;
+    uint32_t all_zones = (ZONE_COUNT < 32) ? (1u << ZONE_COUNT) - 1 : 0xFFFFFFFFu;
+    do {
+        for (int i = 0; i < 1000; i++) {
+            for (int z = 0; z < (int)ZONE_COUNT; z++) data[z].light_level = 800 + ((i + z) & 0xFF); //keeps the PID off its settling shortcut
+            now_us += 10000000; //one frame per zone every 10 s, as the limiter lets through
+            plant_control_step(&ctl, data, thresh, CTRL_EVT_SENSOR, all_zones, now_us, &local_time, &actions);
+            bench_sink += ctl.light_level[0];
+        }
+        ops += 1000;
+    } while ((elapsed = now_ns() - start) < BENCH_MIN_NS);
+    report("control step", elapsed, ops, 0);
+}
+
+static void bench_lut(void) {
+    LightLut lut;
+    light_lut_default(&lut);
+    uint64_t ops = 0;
+    int64_t start = now_ns(), elapsed;
+    do {
+        for (int32_t lux = 0; lux < 4096; lux++) bench_sink += light_lut_level_for_lux(&lut, lux);
+        ops += 4096;
+    } while ((elapsed = now_ns() - start) < BENCH_MIN_NS);
+    report("lut lookup", elapsed, ops, 0);
+}
+
+void bench_run(const TraceFrame *frames, size_t frame_count, const TraceResponse *responses, size_t response_count) {
+    printf("benchmarks:\n");
+    if (frame_count > 0) bench_decode(frames, frame_count);
+    bench_decode_v2();
+    if (response_count > 0) {
+        bench_parse(&responses[0], 64);
+        bench_parse(&responses[0], 256); //the chunk size http_pull_thresholds reads with
+    }
+    bench_control();
+    bench_lut();
+}
@@ -0,0 +1,53 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "replay.h"
+
+//environment:
+//  HOST_REPLAY_CAN_LOG    candump -L trace (default traces/sample_can.log)
+//  HOST_REPLAY_RESPONSES  adafruit thresholds responses (default traces/sample_thresholds.txt)
+//  HOST_REPLAY_MODE       replay, bench or all (default)
+//  HOST_REPLAY_V2_NODES   bitmap of node slots whose frames are v2 pods (default 0, CAN_NODE_PROTOCOLS as built),
+//                         traces/partial_v2_can.log is node 0 as a v2 pod that leaves fields out: HOST_REPLAY_V2_NODES=1
+
+static const char *env_or(const char *name, const char *fallback) {
+    const char *value = getenv(name);
+    return (value != NULL && value[0] != '\0') ? value : fallback;
+}
+
+void app_main(void) {
+    const char *can_log = env_or("HOST_REPLAY_CAN_LOG", "traces/sample_can.log");
+    const char *responses_path = env_or("HOST_REPLAY_RESPONSES", "traces/sample_thresholds.txt");
+    const char *mode = env_or("HOST_REPLAY_MODE", "all");
+    uint32_t v2_nodes = (uint32_t)strtoul(env_or("HOST_REPLAY_V2_NODES", "0"), NULL, 0);
+
+    setenv("TZ", "MST7MDT,M3.2.0,M11.1.0", 1); //same zone as time_sync_init() on the board
+    tzset();
+
+    TraceFrame *frames;
+    TraceResponse *responses;
+    size_t frame_count = trace_load_frames(can_log, &frames);
+    size_t response_count = trace_load_responses(responses_path, &responses);
+    printf("loaded %u frames from %s, %u responses from %s\n", (unsigned)frame_count, can_log, (unsigned)response_count, responses_path);
+    if (frame_count == 0) {
+        printf("error: no CAN frames to replay\n");
+        exit(1);
+    }
+
+    if (strcmp(mode, "bench") != 0) {
+        ReplayStats stats;
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        replay_run(frames, frame_count, responses, response_count, v2_nodes, &stats);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        replay_print(&stats, (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+    }
+    if (strcmp(mode, "replay") != 0) {
+        bench_run(frames, frame_count, responses, response_count);
+    }
+
+    free(frames);
+    trace_free_responses(responses, response_count);
+    exit(0); //nothing to keep running on the host
+}
@@ -0,0 +1,272 @@
+#include "replay.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "can_frame.h"
+#include "threshold_parser.h"
+#include "plant_control.h"
+#include "upload_filter.h"
+#include "sensor_filter.h"
+
+#define REPLAY_LIMIT_S 10.0 //same per-node limiter as control_task
+#define REPLAY_CHUNK 64 //responses go through the parser in pieces, like an HTTP body
+
+static bool parse_candump_line(const char *line, TraceFrame *out) {
+    char iface[16];
+    char frame[64];
+    if (sscanf(line, " (%lf) %15s %63s", &out->t, iface, frame) != 3) return false;
+
+    char *hash = strchr(frame, '#');
+    if (hash == NULL) return false;
+    *hash = '\0';
+
+    size_t id_len = strlen(frame);
+    out->id = (uint32_t)strtoul(frame, NULL, 16);
+    out->extd = id_len > 3; //candump prints 3 digits for standard IDs and 8 for extended ones
+
+    const char *hex = hash + 1;
+    out->dlc = 0;
+    while (hex[0] != '\0' && hex[1] != '\0' && out->dlc < 8) {
+        unsigned byte;
+        if (sscanf(hex, "%2x", &byte) != 1) return false;
+        out->data[out->dlc++] = (uint8_t)byte;
+        hex += 2;
+    }
+    return true;
+}
+
+size_t trace_load_frames(const char *path, TraceFrame **frames) {
+    *frames = NULL;
+    FILE *f = fopen(path, "r");
+    if (f == NULL) return 0;
+
+    size_t count = 0;
+    size_t capacity = 0;
+    char line[128];
+    while (fgets(line, sizeof(line), f) != NULL) {
+        TraceFrame frame;
+        if (!parse_candump_line(line, &frame)) continue;
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 1024;
+            TraceFrame *grown = realloc(*frames, capacity * sizeof(TraceFrame));
+            if (grown == NULL) break;
+            *frames = grown;
+        }
+        (*frames)[count++] = frame;
+    }
+    fclose(f);
+    return count;
+}
+
+size_t trace_load_responses(const char *path, TraceResponse **responses) {
+    *responses = NULL;
+    FILE *f = fopen(path, "r");
+    if (f == NULL) return 0;
+
+    size_t count = 0;
+    char *line = NULL;
+    size_t line_cap = 0;
+    ssize_t len;
+    while ((len = getline(&line, &line_cap, f)) > 0) {
+        char *body;
+        double t = strtod(line, &body);
+        if (body == line) continue;
+        while (*body == ' ') body++;
+
+        TraceResponse *grown = realloc(*responses, (count + 1) * sizeof(TraceResponse));
+        if (grown == NULL) break;
+        *responses = grown;
+
+        size_t body_len = strcspn(body, "\r\n");
+        TraceResponse *r = &(*responses)[count++];
+        r->t = t;
+        r->len = body_len;
+        r->body = strndup(body, body_len);
+    }
+    free(line);
+    fclose(f);
+    return count;
+}
+
+void trace_free_responses(TraceResponse *responses, size_t count) {
+    for (size_t i = 0; i < count; i++) free(responses[i].body);
+    free(responses);
+}
+
+static double wall_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+typedef struct {
+    PlantControl ctl;
+    ThresholdData thresh[ZONE_COUNT];
+    SensorData latest[ZONE_COUNT]; //reading each zone's control path sees
+    UploadFilter upload;
+    double deadline; //simulated esp_timer, < 0 when stopped
+    double last_t;
+    ReplayStats *stats;
+} Replay;
+
+static void account(Replay *r, double t) { //integrate outputs up to t
+    double dt = t - r->last_t;
+    if (r->last_t > 0 && dt > 0) {
+        for (int z = 0; z < (int)ZONE_COUNT; z++) { //summed over zones
+            if (r->ctl.pump_on[z]) r->stats->pump_on_s += dt;
+            if (r->ctl.light_level[z] > 0) {
+                r->stats->light_on_s += dt;
+                r->stats->light_level_avg += r->ctl.light_level[z] * dt; //divided by light_on_s at the end
+            }
+        }
+    }
+    r->last_t = t;
+}
+
+static void step(Replay *r, double t, uint32_t events, uint32_t sensor_mask) {
+    account(r, t);
+
+    time_t now = (time_t)t;
+    struct tm local_time;
+    localtime_r(&now, &local_time);
+
+    bool was_pumping[ZONE_COUNT];
+    memcpy(was_pumping, r->ctl.pump_on, sizeof(was_pumping));
+    PlantActions actions;
+    int64_t now_us = (int64_t)(t * 1e6); //the simulated clock stands in for esp_timer_get_time
+    double start = wall_us();
+    plant_control_step(&r->ctl, r->latest, r->thresh, events, sensor_mask, now_us, &local_time, &actions);
+    r->stats->control_us += wall_us() - start;
+    r->stats->control_steps++;
+
+    r->deadline = (actions.next_deadline_us != 0) ? actions.next_deadline_us / 1e6 : -1;
+    for (int z = 0; z < (int)ZONE_COUNT; z++) {
+        if (!was_pumping[z] && r->ctl.pump_on[z]) r->stats->pump_starts++;
+    }
+}
+
+void replay_run(const TraceFrame *frames, size_t frame_count, const TraceResponse *responses, size_t response_count, uint32_t v2_nodes,
+                ReplayStats *stats) {
+    static Replay r; //PlantControl carries the LUT, keep it off the task stack
+    memset(&r, 0, sizeof(r));
+    memset(stats, 0, sizeof(*stats));
+    r.stats = stats;
+    r.deadline = -1;
+
+    plant_control_init(&r.ctl);
+    upload_filter_init(&r.upload);
+    for (int z = 0; z < (int)ZONE_COUNT; z++) {
+        r.thresh[z] = (ThresholdData){ //same safe defaults as app_main
+            .light_intensity = 1, .moisture = 100, .temperature = 25, .on_off_toggle = 1, .light_hours = 12.0, .water_now = 0,
+        };
+    }
+
+    double last_read[CAN_NODE_COUNT] = {0};
+    static CanDecoder decoder;
+    can_decoder_init(&decoder);
+    for (int n = 0; n < (int)CAN_NODE_COUNT; n++) {
+        if (v2_nodes & (1u << n)) decoder.protocol[n] = CAN_PROTOCOL_V2;
+    }
+    static SensorFilter filters[CAN_NODE_COUNT];
+    for (int n = 0; n < (int)CAN_NODE_COUNT; n++) sensor_filter_init(&filters[n]);
+    int cloud_water_now = 0;
+    size_t fi = 0, ri = 0;
+    double first_t = (frame_count > 0) ? frames[0].t : 0;
+
+    while (fi < frame_count || ri < response_count) {
+        double frame_t = (fi < frame_count) ? frames[fi].t : 1e300;
+        double response_t = (ri < response_count) ? responses[ri].t : 1e300;
+
+        if (r.deadline >= 0 && r.deadline <= frame_t && r.deadline <= response_t) { //the timer fires first when due
+            double t = r.deadline;
+            r.deadline = -1;
+            step(&r, t, CTRL_EVT_TIMER, 0);
+            continue;
+        }
+
+        if (response_t <= frame_t) {
+            const TraceResponse *resp = &responses[ri++];
+            stats->responses++;
+
+            ThresholdData parsed = r.thresh[0]; //the cloud thresholds group is shared by every zone
+            ThresholdParser parser;
+            threshold_parser_init(&parser, &parsed);
+            for (size_t off = 0; off < resp->len; off += REPLAY_CHUNK) {
+                size_t n = (resp->len - off < REPLAY_CHUNK) ? resp->len - off : REPLAY_CHUNK;
+                if (!threshold_parser_feed(&parser, resp->body + off, n)) break;
+            }
+            if (threshold_parser_finish(&parser) <= 0) {
+                stats->response_errors++;
+                continue;
+            }
+
+            bool pressed = parsed.water_now == 1 && cloud_water_now == 0; //same edge detection as adafruit_rx_task
+            cloud_water_now = parsed.water_now;
+            parsed.water_now = pressed ? 1 : 0;
+            for (int z = 0; z < (int)ZONE_COUNT; z++) r.thresh[z] = parsed;
+            if (pressed) stats->water_now_presses++;
+            step(&r, resp->t, CTRL_EVT_THRESHOLDS, 0);
+            continue;
+        }
+
+        const TraceFrame *frame = &frames[fi++];
+        stats->frames++;
+        SensorData data = {0};
+        CanDecodeResult result = can_decoder_feed(&decoder, frame->id, frame->extd, frame->dlc, frame->data, &data);
+        if (result != CAN_DECODE_SAMPLE) {
+            if (result == CAN_DECODE_PENDING) stats->pending++;
+            else stats->filtered++;
+            continue;
+        }
+        stats->decoded++;
+        data.water_level = true; //traces don't carry the float switch, the reservoir is assumed full
+
+        if (SENSOR_FILTER_ENABLE) { //same filter stage as control_task, ahead of the upload check and the limiter
+            uint32_t raw_fields = 0;
+            for (int z = 0; z < (int)ZONE_COUNT; z++) {
+                if (zone_config[z].node == data.node && r.ctl.cal[z].active && r.ctl.cal[z].started) raw_fields |= 1u << SENSOR_FILTER_LIGHT;
+            }
+            stats->sensor_outliers += sensor_filter_apply(&filters[data.node], &data, raw_fields);
+        }
+
+        if (data.node == CAN_PRIMARY_NODE) { //same report-on-change check as control_task, ahead of the limiter
+            uint8_t feeds = upload_filter_check(&r.upload, &data, (int64_t)(frame->t * 1e6));
+            if (feeds != 0) stats->upload_samples++;
+            stats->upload_points += __builtin_popcount(feeds);
+            if (frame->t - last_read[data.node] >= REPLAY_LIMIT_S) stats->fixed_points += UPLOAD_FEED_COUNT;
+        }
+
+        if (frame->t - last_read[data.node] < REPLAY_LIMIT_S) {
+            stats->limited++;
+            continue;
+        }
+        last_read[data.node] = frame->t;
+
+        uint32_t sensor_mask = 0;
+        for (int z = 0; z < (int)ZONE_COUNT; z++) {
+            if (zone_config[z].node != data.node) continue;
+            r.latest[z] = data;
+            sensor_mask |= 1u << z;
+        }
+        if (sensor_mask == 0) continue;
+        step(&r, frame->t, CTRL_EVT_SENSOR, sensor_mask);
+    }
+
+    stats->lost = decoder.lost_total;
+    account(&r, r.last_t);
+    stats->trace_s = r.last_t - first_t;
+    if (stats->light_on_s > 0) stats->light_level_avg /= stats->light_on_s;
+}
+
+void replay_print(const ReplayStats *stats, double wall_s) {
+    printf("replay: %.0f s of trace in %.4f s (%.0fx real time)\n", stats->trace_s, wall_s, (wall_s > 0) ? stats->trace_s / wall_s : 0);
+    printf("  frames %u decoded %u filtered %u limited %u\n", stats->frames, stats->decoded, stats->filtered, stats->limited);
+    printf("  multi-frame parts %u, lost messages %u\n", stats->pending, stats->lost);
+    printf("  responses %u errors %u water-now presses %u\n", stats->responses, stats->response_errors, stats->water_now_presses);
+    printf("  control steps %u, %.2f us each\n", stats->control_steps, stats->control_steps ? stats->control_us / stats->control_steps : 0);
+    printf("  pump starts %u, on for %.0f s\n", stats->pump_starts, stats->pump_on_s);
+    printf("  uploads %u, %u data points (%u at the fixed 10 s cadence)\n", stats->upload_samples, stats->upload_points, stats->fixed_points);
+    printf("  sensor readings held as outliers %u\n", stats->sensor_outliers);
+    printf("  light on for %.0f s, average level %.0f of %d\n", stats->light_on_s, stats->light_level_avg, LIGHT_LEVEL_MAX);
+}
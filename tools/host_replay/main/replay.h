@@ -0,0 +1,60 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//recorded inputs. CAN traces are `candump -L` logs: "(<unix time>) <if> <id>#<hex data>".
+//adafruit traces hold one thresholds group response (GET /groups/<key>) per line: "<unix time> <json>".
+
+typedef struct {
+    double t;
+    uint32_t id;
+    bool extd;
+    uint8_t dlc;
+    uint8_t data[8];
+} TraceFrame;
+
+typedef struct {
+    double t;
+    char *body;
+    size_t len;
+} TraceResponse;
+
+size_t trace_load_frames(const char *path, TraceFrame **frames); //returns the frame count, caller frees
+size_t trace_load_responses(const char *path, TraceResponse **responses);
+void trace_free_responses(TraceResponse *responses, size_t count);
+
+typedef struct {
+    uint32_t frames;
+    uint32_t decoded;
+    uint32_t filtered; //unknown ID, extended or short frame
+    uint32_t pending; //non-final frames of v2 multi-frame messages
+    uint32_t lost; //v2 sequence gaps
+    uint32_t limited; //dropped by the 10 second per-node limiter
+    uint32_t responses;
+    uint32_t response_errors; //malformed or nothing applied
+    uint32_t control_steps;
+    uint32_t pump_starts;
+    uint32_t water_now_presses;
+    uint32_t upload_samples; //primary node frames the upload filter let through
+    uint32_t upload_points; //feed values in them
+    uint32_t fixed_points; //feed values the old 10 second cadence would have sent
+    uint32_t sensor_outliers; //field readings the sensor filter held back
+    double pump_on_s;
+    double light_on_s;
+    double light_level_avg; //over the time the light was on
+    double trace_s; //simulated time covered
+    double control_us; //wall time spent inside plant_control_step
+} ReplayStats;
+
+//runs both traces through the firmware's control path on a simulated clock, as fast as the host allows.
+//node slots with their bit in v2_nodes are decoded as v2 pods, the others as in CAN_NODE_PROTOCOLS
+void replay_run(const TraceFrame *frames, size_t frame_count, const TraceResponse *responses, size_t response_count, uint32_t v2_nodes,
+                ReplayStats *stats);
+void replay_print(const ReplayStats *stats, double wall_s);
+
+void bench_run(const TraceFrame *frames, size_t frame_count, const TraceResponse *responses, size_t response_count);
+
+#endif